@@ -30,16 +30,16 @@ static u8 pld_to_pal[] = {
 	56, 57, 58, 59, 60, 61, 62, 63
 };
 
-static int zzt_load_chr(void *data, int dlen) {
-	u8 *data8 = (u8*) data;
+static int zzt_load_chr(const void *data, int dlen) {
+	const u8 *data8 = (const u8*) data;
 
 	if ((dlen & 0xFF) != 0) return -1;
 	return zzt_load_charset(8, dlen >> 8, data8);
 }
 
-static int zzt_load_pal(void *data, int dlen) {
+static int zzt_load_pal(const void *data, int dlen) {
 	u32 palette[16];
-	u8 *data8 = (u8*) data;
+	const u8 *data8 = (const u8*) data;
 
 	if (dlen < 48) return -1;
 
@@ -55,9 +55,9 @@ static int zzt_load_pal(void *data, int dlen) {
 	return zzt_load_palette(palette);
 }
 
-static int zzt_load_pld(void *data, int dlen) {
+static int zzt_load_pld(const void *data, int dlen) {
 	u32 palette[16];
-	u8 *data8 = (u8*) data;
+	const u8 *data8 = (const u8*) data;
 
 	if (dlen < 192) return -1;
 
@@ -73,7 +73,7 @@ static int zzt_load_pld(void *data, int dlen) {
 	return zzt_load_palette(palette);
 }
 
-int zzt_load_asset(char *type, void *data, int dlen) {
+int zzt_load_asset(char *type, const void *data, int dlen) {
 	char category[17];
 	char *format = strchr(type, ':') + 1;
 	if ((format - type) > 16) return -1; // overflow protection
@@ -26,6 +26,6 @@
 #include "zzt.h"
 
 USER_FUNCTION
-int zzt_load_asset(char *type, void *data, int dlen);
+int zzt_load_asset(char *type, const void *data, int dlen);
 
 #endif /* __ASSET_LOADER_H__ */
@@ -0,0 +1,248 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+#include "cas_vfs.h"
+
+#ifdef _WIN32
+cas_store *cas_store_open(const char *directory) { return NULL; }
+void cas_store_close(cas_store *store) { }
+const u8 *cas_object_acquire(cas_store *store, const u8 *key, u32 crc, int size, int *id) { return NULL; }
+const u8 *cas_object_store(cas_store *store, const u8 *key, const u8 *data, int size, u32 crc, int *id) { return NULL; }
+void cas_object_release(cas_store *store, int id) { }
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define CAS_MAX_PATH 259
+#define CAS_HASH_SIZE VFS_SHA256_SIZE
+
+typedef struct {
+	u8 key[CAS_KEY_SIZE];
+	u32 crc;
+	int size;
+	u8 *map;
+	int refs;
+} cas_object;
+
+struct cas_store {
+	char directory[CAS_MAX_PATH + 1];
+	// objects mapped by this process, which stay mapped until the store
+	// is closed, so that each is only checked once
+	cas_object *objects;
+	int object_count, object_size;
+#ifdef USE_PTHREADS
+	pthread_mutex_t lock;
+#endif
+};
+
+static void cas_hex(const u8 *hash, char *hex) {
+	for (int i = 0; i < CAS_HASH_SIZE; i++) {
+		sprintf(hex + i * 2, "%02x", hash[i]);
+	}
+}
+
+static void cas_index_path(cas_store *store, const u8 *key, char *path, int len) {
+	char hex[CAS_HASH_SIZE * 2 + 1];
+
+	cas_hex(key, hex);
+	snprintf(path, len, "%s/index/%s", store->directory, hex);
+}
+
+cas_store *cas_store_open(const char *directory) {
+	char path[CAS_MAX_PATH * 2];
+
+	if (strlen(directory) > CAS_MAX_PATH) return NULL;
+	snprintf(path, sizeof(path), "%s/objects", directory);
+	mkdir(directory, 0777);
+	mkdir(path, 0777);
+	snprintf(path, sizeof(path), "%s/index", directory);
+	mkdir(path, 0777);
+	if (access(path, W_OK) != 0) return NULL;
+
+	cas_store *store = calloc(1, sizeof(cas_store));
+	if (store == NULL) return NULL;
+	strcpy(store->directory, directory);
+#ifdef USE_PTHREADS
+	pthread_mutex_init(&store->lock, NULL);
+#endif
+	return store;
+}
+
+void cas_store_close(cas_store *store) {
+	for (int i = 0; i < store->object_count; i++) {
+		munmap(store->objects[i].map, store->objects[i].size);
+	}
+	free(store->objects);
+#ifdef USE_PTHREADS
+	pthread_mutex_destroy(&store->lock);
+#endif
+	free(store);
+}
+
+// maps the object the index names, checking it; to be called with the
+// lock held
+static u8 *cas_object_map(cas_store *store, const u8 *key, u32 crc, int size) {
+	char path[CAS_MAX_PATH * 2];
+	char index_path[CAS_MAX_PATH * 2];
+	char hex[CAS_HASH_SIZE * 2 + 1];
+	u8 hash[CAS_HASH_SIZE];
+	struct stat st;
+
+	cas_index_path(store, key, index_path, sizeof(index_path));
+	FILE *file = fopen(index_path, "rb");
+	if (file == NULL) return NULL;
+	int hex_len = fread(hex, 1, CAS_HASH_SIZE * 2, file);
+	fclose(file);
+	hex[CAS_HASH_SIZE * 2] = 0;
+	if (hex_len != CAS_HASH_SIZE * 2 || strspn(hex, "0123456789abcdef") != CAS_HASH_SIZE * 2) {
+		remove(index_path);
+		return NULL;
+	}
+
+	snprintf(path, sizeof(path), "%s/objects/%s", store->directory, hex);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		remove(index_path);
+		return NULL;
+	}
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size == size) {
+		map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	} else {
+		// the index was written along with an object of this size
+		fprintf(stderr, "Removing broken cache object %s!\n", path);
+		remove(path);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		remove(index_path);
+		return NULL;
+	}
+
+	// the name vouches for the contents, the CRC-32 for the index
+	char hex_actual[CAS_HASH_SIZE * 2 + 1];
+	vfs_sha256((const u8*) map, size, hash);
+	cas_hex(hash, hex_actual);
+	if (strcmp(hex, hex_actual) != 0) {
+		fprintf(stderr, "Removing broken cache object %s!\n", path);
+		munmap(map, size);
+		remove(path);
+		remove(index_path);
+		return NULL;
+	}
+	if (crc32(0, (const u8*) map, size) != crc) {
+		munmap(map, size);
+		remove(index_path);
+		return NULL;
+	}
+	return (u8*) map;
+}
+
+const u8 *cas_object_acquire(cas_store *store, const u8 *key, u32 crc, int size, int *id) {
+	const u8 *data = NULL;
+
+	// empty files cannot be mapped
+	if (size <= 0) return NULL;
+
+#ifdef USE_PTHREADS
+	pthread_mutex_lock(&store->lock);
+#endif
+	for (int i = 0; i < store->object_count; i++) {
+		cas_object *o = &store->objects[i];
+		if (o->crc == crc && o->size == size && memcmp(o->key, key, CAS_KEY_SIZE) == 0) {
+			o->refs++;
+			*id = i;
+			data = o->map;
+			break;
+		}
+	}
+
+	if (data == NULL && store->object_count >= store->object_size) {
+		int size_new = store->object_size > 0 ? store->object_size * 2 : 16;
+		cas_object *objects_new = realloc(store->objects, sizeof(cas_object) * size_new);
+		if (objects_new != NULL) {
+			store->objects = objects_new;
+			store->object_size = size_new;
+		}
+	}
+	if (data == NULL && store->object_count < store->object_size) {
+		u8 *map = cas_object_map(store, key, crc, size);
+		if (map != NULL) {
+			cas_object *o = &store->objects[store->object_count];
+			memcpy(o->key, key, CAS_KEY_SIZE);
+			o->crc = crc;
+			o->size = size;
+			o->map = map;
+			o->refs = 1;
+			*id = store->object_count++;
+			data = map;
+		}
+	}
+#ifdef USE_PTHREADS
+	pthread_mutex_unlock(&store->lock);
+#endif
+	return data;
+}
+
+const u8 *cas_object_store(cas_store *store, const u8 *key, const u8 *data, int size, u32 crc, int *id) {
+	char path[CAS_MAX_PATH * 2];
+	char hex[CAS_HASH_SIZE * 2 + 1];
+	u8 hash[CAS_HASH_SIZE];
+	struct stat st;
+
+	if (size <= 0) return NULL;
+
+	// another process may have saved it meanwhile; the copies are the
+	// same. One of the wrong size is broken, and replaced
+	vfs_sha256(data, size, hash);
+	cas_hex(hash, hex);
+	snprintf(path, sizeof(path), "%s/objects/%s", store->directory, hex);
+	if ((stat(path, &st) != 0 || st.st_size != size) && vfs_write_file(path, data, size, 0) < 0) return NULL;
+	cas_index_path(store, key, path, sizeof(path));
+	if (vfs_write_file(path, hex, CAS_HASH_SIZE * 2, 0) < 0) return NULL;
+
+	return cas_object_acquire(store, key, crc, size, id);
+}
+
+void cas_object_release(cas_store *store, int id) {
+#ifdef USE_PTHREADS
+	pthread_mutex_lock(&store->lock);
+#endif
+	store->objects[id].refs--;
+#ifdef USE_PTHREADS
+	pthread_mutex_unlock(&store->lock);
+#endif
+}
+
+#endif /* !_WIN32 */
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __CAS_VFS_H__
+#define __CAS_VFS_H__
+
+#include "types.h"
+#include "vfs_util.h"
+
+// content-addressed store of unpacked files, shared by all processes
+// using the same directory: every object is saved once, named by the
+// SHA-256 of its contents, and mapped read-only, so that the pages are
+// shared. Objects are found by a key of CAS_KEY_SIZE bytes the caller
+// derives from where the contents come from, which must be a hash that
+// cannot be made to collide, such as zip_entry_digest(): a key that
+// could, like a CRC-32, would let one archive's members stand in for
+// another's. They are checked against their name and the CRC-32 the
+// first time this process maps them; broken objects are removed.
+//
+// Whoever can write to the directory can plant objects for any key, so
+// it must only be writable by users trusted with every process using it
+
+#define CAS_KEY_SIZE VFS_SHA256_SIZE
+
+typedef struct cas_store cas_store;
+
+// creates the directory's layout if missing; NULL where mapping files
+// is not supported
+cas_store *cas_store_open(const char *directory);
+// no objects may be acquired
+void cas_store_close(cas_store *store);
+
+// the contents of a stored object, valid until released; NULL if there
+// is no intact one
+const u8 *cas_object_acquire(cas_store *store, const u8 *key, u32 crc, int size, int *id);
+// saves data, known to match key and crc, then acquires the saved copy
+const u8 *cas_object_store(cas_store *store, const u8 *key, const u8 *data, int size, u32 crc, int *id);
+void cas_object_release(cas_store *store, int id);
+
+#endif /* __CAS_VFS_H__ */
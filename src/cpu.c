@@ -66,11 +66,14 @@ static s16 ram_s16(cpu_state* cpu, u32 addr) {
 
 static void ram_w8(cpu_state* cpu, u32 addr, u8 v) {
 	*((u8*) (cpu->ram + addr)) = v;
+	cpu->ram_pages[addr >> CPU_PAGE_SHIFT] = CPU_PAGE_ALL;
 }
 
 static void ram_w16(cpu_state* cpu, u32 addr, u16 v) {
 #if defined(UNALIGNED_OK) && !defined(BIG_ENDIAN)
 	*((u16*) (cpu->ram + addr)) = v;
+	cpu->ram_pages[addr >> CPU_PAGE_SHIFT] = CPU_PAGE_ALL;
+	cpu->ram_pages[((addr + 1) & 0xFFFFF) >> CPU_PAGE_SHIFT] = CPU_PAGE_ALL;
 #else
 	ram_w8(cpu, addr, (u8) v);
 	ram_w8(cpu, addr + 1, (u8) (v >> 8));
@@ -158,6 +161,16 @@ static u16 incdec_dir(cpu_state* cpu, u16 reg, u16 amount) {
 	}
 }
 
+void cpu_mark_ram(cpu_state* cpu, u32 addr, u32 len) {
+	if (len == 0) return;
+	u32 first = (addr & 0xFFFFF) >> CPU_PAGE_SHIFT;
+	u32 last = ((addr + len - 1) & 0xFFFFF) >> CPU_PAGE_SHIFT;
+	if (last < first) last = CPU_PAGE_COUNT - 1;
+
+	for (u32 i = first; i <= last; i++)
+		cpu->ram_pages[i] = CPU_PAGE_ALL;
+}
+
 void cpu_set_ip(cpu_state* cpu, u16 cs, u16 ip) {
 	cpu->seg[SEG_CS] = cs;
 	cpu->ip = ip;
@@ -672,6 +685,76 @@ static int cpu_pop_interrupt(cpu_state* cpu) {
 #define REP_COND_NZ 0
 #define REP_COND_Z 1
 
+// Native loops for the string instructions used by Turbo Pascal's
+// Move, FillChar and string routines; equivalent to executing them one
+// by one, without decoding the instruction on every iteration.
+// Random and the longint multiply are matched as native routines (see zzt.c).
+static int cpu_rep_fast(cpu_state* cpu, u8 opcode, int cond) {
+	u16 amt = (opcode & 1) ? 2 : 1;
+	u32 len = cpu->cx * amt;
+
+	switch (opcode) {
+		case 0xA4: case 0xA5: { /* MOVS */
+			u32 src = SEGMD(SEG_DS, cpu->si);
+			u32 dst = SEG(SEG_ES, cpu->di);
+			if (!FLAG(FLAG_DIRECTION) && (cpu->si + len) <= 0x10000 && (cpu->di + len) <= 0x10000
+				&& (src + len) <= 0x100000 && (dst + len) <= 0x100000
+				&& (dst <= src || dst >= (src + len))) {
+				memmove(cpu->ram + dst, cpu->ram + src, len);
+				cpu_mark_ram(cpu, dst, len);
+				cpu->si += len;
+				cpu->di += len;
+				cpu->cx = 0;
+				return 1;
+			}
+			for (; cpu->cx != 0; cpu->cx--) {
+				src = SEGMD(SEG_DS, cpu->si);
+				dst = SEG(SEG_ES, cpu->di);
+				if (amt == 2) ram_w16(cpu, dst, ram_u16(cpu, src));
+				else ram_w8(cpu, dst, ram_u8(cpu, src));
+				cpu->si = incdec_dir(cpu, cpu->si, amt);
+				cpu->di = incdec_dir(cpu, cpu->di, amt);
+			}
+		} return 1;
+		case 0xAA: case 0xAB: { /* STOS */
+			u32 dst = SEG(SEG_ES, cpu->di);
+			if (amt == 1 && !FLAG(FLAG_DIRECTION) && (cpu->di + len) <= 0x10000 && (dst + len) <= 0x100000) {
+				memset(cpu->ram + dst, cpu->al, len);
+				cpu_mark_ram(cpu, dst, len);
+				cpu->di += len;
+				cpu->cx = 0;
+				return 1;
+			}
+			for (; cpu->cx != 0; cpu->cx--) {
+				dst = SEG(SEG_ES, cpu->di);
+				if (amt == 2) ram_w16(cpu, dst, cpu->ax);
+				else ram_w8(cpu, dst, cpu->al);
+				cpu->di = incdec_dir(cpu, cpu->di, amt);
+			}
+		} return 1;
+		case 0xA6: case 0xA7: /* CMPS */
+		case 0xAE: case 0xAF: /* SCAS */
+			while (cpu->cx != 0) {
+				u32 dst = SEG(SEG_ES, cpu->di);
+				u16 v2 = (amt == 2) ? ram_u16(cpu, dst) : ram_u8(cpu, dst);
+				if (opcode <= 0xA7) {
+					u32 src = SEGMD(SEG_DS, cpu->si);
+					u16 v1 = (amt == 2) ? ram_u16(cpu, src) : ram_u8(cpu, src);
+					cpu_cmp(cpu, v1, v2, amt - 1);
+					cpu->si = incdec_dir(cpu, cpu->si, amt);
+				} else {
+					cpu_cmp(cpu, (amt == 2) ? cpu->ax : cpu->al, v2, opcode);
+				}
+				cpu->di = incdec_dir(cpu, cpu->di, amt);
+				cpu->cx--;
+				if (FLAG(FLAG_ZERO) != (cond == REP_COND_Z)) break;
+			}
+			return 1;
+	}
+
+	return 0;
+}
+
 static int cpu_rep(cpu_state* cpu, int cond) {
 	u16 old_ip = cpu->ip;
 	u8 opcode = cpu_advance_ip(cpu);
@@ -682,6 +765,10 @@ static int cpu_rep(cpu_state* cpu, int cond) {
 		return STATE_CONTINUE;
 	}
 
+	if (cpu_rep_fast(cpu, opcode, cond)) {
+		return STATE_CONTINUE;
+	}
+
 	cpu->ip = old_ip;
 	u8 pr_state = 1;
 	u8 skip_conds = opcode != 0xA6 && opcode != 0xA7 && opcode != 0xAE && opcode != 0xAF;
@@ -1616,6 +1703,8 @@ void cpu_init(cpu_state* cpu) {
 #else
 	memset(cpu->ram + 1024, 0, 1048576 - 1024);
 #endif
+	for (i = 0; i < CPU_PAGE_COUNT; i++)
+		cpu->ram_pages[i] = 0;
 
 	// ivt
 	for (i = 0; i < 256; i++) {
@@ -1627,4 +1716,5 @@ void cpu_init(cpu_state* cpu) {
 	// TODO: remove IRET from implemented ivts
 	for (i = 0xF1100; i < 0xF1200; i++)
 		cpu->ram[i] = 0xCF; /* IRET */
+	cpu_mark_ram(cpu, 0xF1100, 0x100);
 }
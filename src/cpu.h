@@ -42,8 +42,20 @@
 #define SEG_SS 2
 #define SEG_DS 3
 
+// RAM write tracking, in pages of CPU_PAGE_SIZE bytes.
+// Every write sets all flag bits of its page; each consumer clears its own.
+#define CPU_PAGE_SHIFT 10
+#define CPU_PAGE_SIZE (1 << CPU_PAGE_SHIFT)
+#define CPU_PAGE_COUNT (1048576 >> CPU_PAGE_SHIFT)
+#define CPU_PAGE_ALL 0xFF
+#define CPU_PAGE_TOUCHED 0x01 /* since cpu_init */
+#define CPU_PAGE_FORK 0x02 /* since last fork sync */
+#define CPU_PAGE_REWIND 0x04 /* since last rewind capture */
+#define CPU_PAGE_VRAM 0x08 /* since last zzt_vram_get_dirty */
+
 struct s_cpu_state {
 	u8 ram[1048576];
+	u8 ram_pages[CPU_PAGE_COUNT];
 
 	struct {
 		union {
@@ -122,6 +134,8 @@ int cpu_execute(cpu_state* cpu, int cycles);
 void cpu_push16(cpu_state* cpu, u16 v);
 u16 cpu_pop16(cpu_state* cpu);
 
+void cpu_mark_ram(cpu_state* cpu, u32 addr, u32 len);
+
 void cpu_emit_interrupt(cpu_state* cpu, u8 intr);
 void cpu_set_ip(cpu_state* cpu, u16 cs, u16 ip);
 
@@ -14,6 +14,9 @@ mergeInto(LibraryManager.library, {
 	vfs_read: function(h, ptr, amount) {
 		return vfsg_read(h, ptr, amount);
 	},
+	vfs_get_data: function(h, len_ptr) {
+		return 0;
+	},
 	vfs_write: function(h, ptr, amount) {
 		return vfsg_write(h, ptr, amount);
 	},
@@ -26,6 +29,14 @@ mergeInto(LibraryManager.library, {
 	vfs_findnext: function(ptr) {
 		return vfsg_findnext(ptr);
 	},
+	vfs_fork_create: function(id) {
+		return -1;
+	},
+	vfs_fork_switch: function(id) {
+		return -1;
+	},
+	vfs_fork_free: function(id) {
+	},
 	zeta_has_feature: function(id) {
 		return vfsg_has_feature(id);
 	},
@@ -59,10 +59,19 @@ int zeta_has_feature(int feature) {
 	return 1;
 }
 
+// only used for the board atlas
+static u8 *curses_charset;
+static int curses_charw, curses_charh;
+static u32 *curses_palette;
+
 void zeta_update_charset(int width, int height, u8* data) {
+	curses_charw = width;
+	curses_charh = height;
+	curses_charset = data;
 }
 
 void zeta_update_palette(u32* data) {
+	curses_palette = data;
 }
 
 static void platform_kbd_tick(void) {
@@ -99,6 +108,10 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 
+	if (posix_zzt_arg_atlas_dir != NULL) {
+		return posix_zzt_atlas(curses_charset, curses_charw, curses_charh, curses_palette);
+	}
+
 	setlocale(LC_ALL, "");
 
 	window = initscr();
@@ -116,14 +129,17 @@ int main(int argc, char** argv) {
 /*	clock_t last = clock();
 	clock_t curr = last; */
 
-	long timer_ms = zeta_time_ms();
-	long render_ms = timer_ms;
+	long render_ms = zeta_time_ms();
+	double timer_ms = render_ms;
 
 	int rcode = 0;
 
 	while ((rcode = zzt_execute(64000)) > 0) {
 		long curr_ms = zeta_time_ms();
 
+		if (rcode == STATE_WAIT) posix_zzt_boot_cache_update();
+		posix_zzt_log_drain();
+
 		if ((curr_ms - render_ms) >= 10) {
 			// refresh screen
 			u8* ram = zzt_get_ram();
@@ -149,20 +165,29 @@ int main(int argc, char** argv) {
 		fprintf(stderr, "%.2f opc/sec\n", 1600000.0f / secs);
 		last = curr; */
 
+		int speed = zzt_get_speed();
+		double tick_ms = (speed > 1) ? (SYS_TIMER_TIME / speed) : SYS_TIMER_TIME;
+
 		if (rcode == 3) {
-			long sleep_time = 55 - (curr_ms - timer_ms);
-			if (sleep_time > 1) {
+			long sleep_time = (long) (tick_ms - (curr_ms - timer_ms));
+			if (speed == ZZT_SPEED_UNLIMITED) {
+				zzt_mark_timer_turbo();
+			} else if (sleep_time > 1) {
 				usleep(sleep_time * 1000);
 			}
 		}
 
-		if ((curr_ms - timer_ms) >= 55) {
+		if ((curr_ms - timer_ms) >= tick_ms) {
 			zzt_mark_timer();
-			timer_ms = curr_ms;
+			// keep the fractional part, so that 8x is not rounded to 9x;
+			// after a stall, resume from now instead of bursting
+			timer_ms += tick_ms;
+			if ((curr_ms - timer_ms) >= tick_ms) timer_ms = curr_ms;
 		}
 
 		platform_kbd_tick();
 	}
 
 	endwin();
+	posix_vfs_flush();
 }
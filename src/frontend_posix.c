@@ -20,7 +20,29 @@
  * SOFTWARE.
  */
 
+#include <signal.h>
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+#include "screenshot_writer.h"
+#include "vfs_util.h"
+
 double posix_zzt_arg_note_delay = -1.0;
+int posix_zzt_arg_run_ahead = 0;
+char *posix_zzt_arg_atlas_dir = NULL;
+static int posix_atlas_workers = 1;
+static char posix_world_name[257];
+
+// file I/O statistics, written on exit and on SIGUSR1
+static char *posix_stats_path = NULL;
+static volatile sig_atomic_t posix_stats_requested = 0;
+
+// post-boot snapshot cache
+static char posix_boot_cache_path[1024];
+static int posix_boot_cache_pending = 0;
+
+#define FNV64_OFFSET 0xCBF29CE484222325ULL
+#define FNV64_PRIME 0x100000001B3ULL
 
 static int posix_vfs_exists(const char *filename) {
 	int h = vfs_open(filename, 0);
@@ -28,17 +50,160 @@ static int posix_vfs_exists(const char *filename) {
 	else { return 0; }
 }
 
+static u64 posix_hash_bytes(u64 h, const u8 *data, int len) {
+	for (int i = 0; i < len; i++) {
+		h = (h ^ data[i]) * FNV64_PRIME;
+	}
+	return h;
+}
+
+static u64 posix_hash_str(u64 h, const char *s) {
+	return posix_hash_bytes(h, (const u8*) s, strlen(s) + 1);
+}
+
+static u64 posix_hash_file(u64 h, const char *filename) {
+	u8 buffer[4096];
+	int len;
+
+	h = posix_hash_str(h, filename);
+	int handle = vfs_open(filename, 0);
+	if (handle < 0) return h;
+	const u8 *data = vfs_get_data(handle, &len);
+	if (data != NULL) {
+		h = posix_hash_bytes(h, data, len);
+		vfs_close(handle);
+		return h;
+	}
+	while ((len = vfs_read(handle, buffer, sizeof(buffer))) > 0) {
+		h = posix_hash_bytes(h, buffer, len);
+	}
+	vfs_close(handle);
+	return h;
+}
+
+static int posix_boot_cache_load(void) {
+	FILE *file = fopen(posix_boot_cache_path, "rb");
+	if (!file) return -1;
+
+	fseek(file, 0, SEEK_END);
+	long fsize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if (fsize <= 4 || fsize > (ZZT_SNAPSHOT_MAX_SIZE + 4096)) {
+		fclose(file);
+		return -1;
+	}
+
+	u8 *buffer = (u8*) malloc((int) fsize);
+	if (!fread(buffer, (int) fsize, 1, file)) {
+		free(buffer);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
+	int snap_len = buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | (buffer[3] << 24);
+	int result = -1;
+	if (snap_len > 0 && snap_len <= (fsize - 4)) {
+		// the handle table is restored first, as it can still be undone
+		if (posix_vfs_load_handles(buffer + 4 + snap_len, fsize - 4 - snap_len) >= 0) {
+			if (zzt_snapshot_load(buffer + 4, snap_len) >= 0) {
+				result = 0;
+			} else {
+				u8 no_handles = 0;
+				posix_vfs_load_handles(&no_handles, 1);
+			}
+		}
+	}
+
+	free(buffer);
+	return result;
+}
+
+static void posix_boot_cache_save(void) {
+	u8 *buffer = (u8*) malloc(ZZT_SNAPSHOT_MAX_SIZE + 4096);
+
+	int snap_len = zzt_snapshot_save(buffer + 4, ZZT_SNAPSHOT_MAX_SIZE);
+	int handles_len = snap_len > 0 ? posix_vfs_save_handles(buffer + 4 + snap_len, 4096) : -1;
+	if (handles_len < 0) {
+		fprintf(stderr, "Could not create boot snapshot!\n");
+		free(buffer);
+		return;
+	}
+
+	buffer[0] = snap_len & 0xFF;
+	buffer[1] = (snap_len >> 8) & 0xFF;
+	buffer[2] = (snap_len >> 16) & 0xFF;
+	buffer[3] = (snap_len >> 24) & 0xFF;
+
+	// concurrent launches never observe a partial snapshot
+	if (vfs_write_file(posix_boot_cache_path, buffer, 4 + snap_len + handles_len, 0) < 0) {
+		fprintf(stderr, "Could not write %s!\n", posix_boot_cache_path);
+	}
+
+	free(buffer);
+}
+
+// to be called by the frontend after zzt_execute; the boot snapshot
+// is taken once the engine first waits for keyboard input
+static void posix_zzt_boot_cache_update(void) {
+	if (posix_boot_cache_pending && zzt_kbd_idle_count() > 0) {
+		posix_boot_cache_pending = 0;
+		posix_boot_cache_save();
+	}
+}
+
+static void posix_stats_write(void) {
+	FILE *file = strcmp(posix_stats_path, "-") == 0 ? stderr : fopen(posix_stats_path, "a");
+	if (file == NULL) {
+		fprintf(stderr, "Could not write statistics to %s!\n", posix_stats_path);
+		return;
+	}
+	posix_vfs_dump_stats(file);
+	if (file != stderr) fclose(file);
+}
+
+#ifdef SIGUSR1
+static void posix_stats_signal(int signum) {
+	posix_stats_requested = 1;
+}
+#endif
+
+// to be called by the frontend periodically, while the emulator is not
+// running; prints queued diagnostics
+static void posix_zzt_log_drain(void) {
+	char msg[128];
+
+	while (zzt_log_drain(msg, sizeof(msg))) {
+		fprintf(stderr, "%s\n", msg);
+	}
+	if (posix_stats_requested) {
+		posix_stats_requested = 0;
+		posix_stats_write();
+	}
+}
+
 static void posix_zzt_help(int argc, char **argv) {
 	char *owner = (argv > 0 && argv[0] != NULL && strlen(argv[0]) > 0) ? argv[0] : "zeta";
 
-	fprintf(stderr, "Usage: %s [arguments] [world file]\n", owner);
+	fprintf(stderr, "Usage: %s [arguments] [world file or .zip archive]\n", owner);
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Arguments ([] - parameter; * - may specify multiple times):\n");
+	fprintf(stderr, "  -A []  render every board of the world to an image and exit;\n");
+	fprintf(stderr, "         in \"directory[:workers]\" form\n");
+	fprintf(stderr, "  -a []  run ahead by [] timer ticks, to reduce input latency\n");
 	fprintf(stderr, "  -b     disable blinking, enable bright backgrounds\n");
+	fprintf(stderr, "  -C []  unpack .zip archive files into directory [], shared\n");
+	fprintf(stderr, "         with other instances, instead of into memory\n");
+	fprintf(stderr, "  -c []  cache post-boot engine state in directory\n");
 	fprintf(stderr, "  -D []  set per-note delay, in milliseconds (floating-point)\n");
 	fprintf(stderr, " *-e []  execute command - repeat to run multiple commands\n");
 	fprintf(stderr, "         by default, ZZT.EXE or SUPERZ.EXE is executed\n");
+	fprintf(stderr, "  -f []  read files ahead in the background: 0 - off (default),\n");
+	fprintf(stderr, "         1 - files being read through, 2 - also all world, board\n");
+	fprintf(stderr, "         and save files at startup\n");
 	fprintf(stderr, "  -h     show help\n");
+	fprintf(stderr, "  -k []  set keyboard buffer size, in keystrokes (1-%d)\n", ZZT_KEYBUF_MAX_SIZE);
 	fprintf(stderr, " *-l []  load asset - in \"type:format:filename\" form or\n");
 	fprintf(stderr, "         \"filename\" form to attempt a guess\n");
 	fprintf(stderr, "         available types/formats: \n");
@@ -48,12 +213,25 @@ static void posix_zzt_help(int argc, char **argv) {
 	fprintf(stderr, "             - pal (MegaZeux-like; 16 colors ranged 00-3F)\n");
 	fprintf(stderr, "             - pld (Toshiba UPAL; 64 EGA colors ranged 00-3F)\n");
 	fprintf(stderr, "  -m []  set memory limit, in KB (64-640)\n");
+	fprintf(stderr, "  -n []  native engine routines: 0 - off, 1 - on (default),\n");
+	fprintf(stderr, "         2 - check against the interpreted code\n");
+	fprintf(stderr, "  -p     preload the world's .zip archive, or the current directory,\n");
+	fprintf(stderr, "         into memory, and do no further file I/O\n");
+	fprintf(stderr, "  -r []  enable rewind, in \"ticks[:megabytes]\" form - capture\n");
+	fprintf(stderr, "         every [ticks] timer ticks, keeping at most [megabytes]\n");
+	fprintf(stderr, "  -s []  set emulation speed: 1, 2, 4, 8 or 0 (unlimited);\n");
+	fprintf(stderr, "         append \"m\" to mute sound while faster than 1\n");
 	fprintf(stderr, "  -t     enable world testing mode (skip K, C, ENTER)\n");
+	fprintf(stderr, "  -v []  write file I/O statistics to file [] (\"-\" for stderr)\n");
+	fprintf(stderr, "         on exit, and on SIGUSR1\n");
+	fprintf(stderr, "  -w []  keep written files in memory, saving them to directory\n");
+	fprintf(stderr, "         [] in the background; append \":s\" to sync every save\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "See <https://zeta.asie.pl/> for more information.\n");
 }
 
 #define IS_EXTENSION(s, e) (strcasecmp((s + strlen((s)) - strlen((e))), (e)) == 0)
+#define POSIX_ZZT_OPTIONS "A:C:D:a:bc:e:f:hk:l:m:n:pr:s:tv:w:"
 
 static int posix_zzt_init(int argc, char **argv) {
 	char arg_name[257];
@@ -64,16 +242,60 @@ static int posix_zzt_init(int argc, char **argv) {
 	int c;
 	int skip_kc = 0;
 	int memory_kbs = -1;
+	char *cache_dir = NULL;
+	char *overlay_dir = NULL;
+	char *store_dir = NULL;
+	int overlay_sync = 0;
+	int preload = 0;
+	int prefetch = POSIX_VFS_PREFETCH_OFF;
+	int rewind_ticks = 0;
+	int hle_mode = ZZT_HLE_ON;
+	int keybuf_size = -1;
+	int speed = 1;
+	int speed_audio = ZZT_SPEED_AUDIO_KEEP;
+	u64 loads_hash = FNV64_OFFSET;
+	int rewind_mbs = ZZT_REWIND_DEFAULT_MAX_BYTES >> 20;
+	char exec_name[257];
 
 #ifdef USE_GETOPT
-	while ((c = getopt(argc, argv, "D:be:hl:m:t")) >= 0) {
+	while ((c = getopt(argc, argv, POSIX_ZZT_OPTIONS)) >= 0) {
 		switch(c) {
+			case 'A': {
+				char *colon_ptr = strrchr(optarg, ':');
+#ifndef _WIN32
+				posix_atlas_workers = sysconf(_SC_NPROCESSORS_ONLN);
+				if (posix_atlas_workers < 1) posix_atlas_workers = 1;
+				else if (posix_atlas_workers > 64) posix_atlas_workers = 64;
+#endif
+				if (colon_ptr != NULL) {
+					colon_ptr[0] = '\0';
+					posix_atlas_workers = atoi(colon_ptr + 1);
+				}
+				if (posix_atlas_workers < 1 || posix_atlas_workers > 64 || optarg[0] == '\0') {
+					fprintf(stderr, "Invalid atlas setting specified!\n");
+					return -1;
+				}
+				posix_zzt_arg_atlas_dir = optarg;
+			} break;
+			case 'C':
+				store_dir = optarg;
+				break;
 			case 'D':
 				posix_zzt_arg_note_delay = atof(optarg);
 				break;
+			case 'a':
+				posix_zzt_arg_run_ahead = atoi(optarg);
+				if (posix_zzt_arg_run_ahead < 0 || posix_zzt_arg_run_ahead > 16) {
+					fprintf(stderr, "Invalid run-ahead amount specified!\n");
+					return -1;
+				}
+				break;
 			case 'b':
 				video_blink = 0;
 				break;
+			case 'c':
+				cache_dir = optarg;
+				break;
 			case 'e':
 				if (exec_count > 16) {
 					fprintf(stderr, "Too many -e commands!\n");
@@ -81,6 +303,13 @@ static int posix_zzt_init(int argc, char **argv) {
 				}
 				execs[exec_count++] = optarg;
 				break;
+			case 'k':
+				keybuf_size = atoi(optarg);
+				if (keybuf_size < 1 || keybuf_size > ZZT_KEYBUF_MAX_SIZE) {
+					fprintf(stderr, "Invalid keyboard buffer size specified!\n");
+					return -1;
+				}
+				break;
 			case 'l':
 				if (load_count > 16) {
 					fprintf(stderr, "Too many -l commands!\n");
@@ -100,6 +329,54 @@ static int posix_zzt_init(int argc, char **argv) {
 					return -1;
 				}
 				break;
+			case 'n':
+				hle_mode = atoi(optarg);
+				if (hle_mode < ZZT_HLE_OFF || hle_mode > ZZT_HLE_VERIFY) {
+					fprintf(stderr, "Invalid native routine mode specified!\n");
+					return -1;
+				}
+				break;
+			case 'r':
+				if (sscanf(optarg, "%d:%d", &rewind_ticks, &rewind_mbs) < 1 || rewind_ticks <= 0 || rewind_mbs <= 0 || rewind_mbs > 2047) {
+					fprintf(stderr, "Invalid rewind setting specified!\n");
+					return -1;
+				}
+				break;
+			case 's': {
+				char *speed_end;
+				long speed_arg = strtol(optarg, &speed_end, 10);
+				int speed_digits = speed_end != optarg;
+				speed_audio = (*speed_end == 'm') ? ZZT_SPEED_AUDIO_MUTE : ZZT_SPEED_AUDIO_KEEP;
+				if (*speed_end == 'm') speed_end++;
+				speed = speed_arg;
+				if (!speed_digits || *speed_end != 0
+					|| speed_arg < 0 || speed_arg > ZZT_SPEED_MAX || (speed & (speed - 1)) != 0) {
+					fprintf(stderr, "Invalid speed specified!\n");
+					posix_zzt_help(argc, argv);
+					return -1;
+				}
+			} break;
+			case 'f':
+				prefetch = atoi(optarg);
+				if (prefetch < POSIX_VFS_PREFETCH_OFF || prefetch > POSIX_VFS_PREFETCH_WORLDS) {
+					fprintf(stderr, "Invalid read-ahead mode specified!\n");
+					return -1;
+				}
+				break;
+			case 'p':
+				preload = 1;
+				break;
+			case 'v':
+				posix_stats_path = optarg;
+				break;
+			case 'w': {
+				int len = strlen(optarg);
+				overlay_dir = optarg;
+				if (len > 2 && strcmp(optarg + len - 2, ":s") == 0) {
+					optarg[len - 2] = '\0';
+					overlay_sync = 1;
+				}
+			} break;
 			case 't':
 				skip_kc = 1;
 				break;
@@ -112,14 +389,54 @@ static int posix_zzt_init(int argc, char **argv) {
 #endif
 
 	zzt_init(memory_kbs);
+	zzt_hle_set_mode(hle_mode);
+	if (keybuf_size > 0) zzt_key_set_buffer_size(keybuf_size);
+	zzt_set_speed(speed, speed_audio);
+
+	if (rewind_ticks > 0 && zzt_rewind_configure(rewind_ticks, rewind_mbs << 20) < 0) {
+		fprintf(stderr, "Could not enable rewind!\n");
+	}
+
+	if (posix_stats_path != NULL) {
+		atexit(posix_stats_write);
+#ifdef SIGUSR1
+		signal(SIGUSR1, posix_stats_signal);
+#endif
+	}
+
+	if (overlay_dir != NULL && posix_vfs_set_overlay(overlay_dir, overlay_sync) < 0) {
+		fprintf(stderr, "Could not enable the save directory!\n");
+		return -1;
+	}
+
+	if (store_dir != NULL && posix_vfs_set_cache(store_dir) < 0) {
+		fprintf(stderr, "Could not use %s as a shared file store!\n", store_dir);
+	}
+
+	if (prefetch != POSIX_VFS_PREFETCH_OFF && posix_vfs_set_prefetch(prefetch) < 0) {
+		fprintf(stderr, "Could not enable read-ahead!\n");
+	}
 
 #ifdef USE_GETOPT
-	if (argc > optind && posix_vfs_exists(argv[optind])) {
-		strncpy(arg_name, argv[optind], 256);
+	char *arg_world = (argc > optind) ? argv[optind] : NULL;
 #else
-	if (argc > 1 && posix_vfs_exists(argv[1])) {
-		strncpy(arg_name, argv[1], 256);
+	char *arg_world = (argc > 1) ? argv[1] : NULL;
 #endif
+	if (arg_world != NULL && strlen(arg_world) > 4 && IS_EXTENSION(arg_world, ".zip")) {
+		// the first world in the archive is played, even if there are
+		// worlds on disk too
+		if ((preload ? posix_vfs_mount_memory(arg_world) : posix_vfs_mount_zip(arg_world)) < 0) {
+			fprintf(stderr, "Could not open %s!\n", arg_world);
+			return -1;
+		}
+		if (posix_vfs_find_mounted_world(arg_name, sizeof(arg_name)) < 0) {
+			arg_name[0] = 0;
+		}
+	} else if (preload && posix_vfs_mount_memory(".") < 0) {
+		fprintf(stderr, "Could not preload the current directory!\n");
+		return -1;
+	} else if (arg_world != NULL && posix_vfs_exists(arg_world)) {
+		strncpy(arg_name, arg_world, 256);
 	} else if (argc > 0) {
 		char *sl_ptr = strrchr(argv[0], '/');
 		if (sl_ptr == NULL)
@@ -155,6 +472,20 @@ static int posix_zzt_init(int argc, char **argv) {
 			type[filename - type - 1] = '\0';
 		}
 
+		// files the VFS holds in memory are loaded in place
+		int handle = vfs_open(filename, 0);
+		int data_len;
+		const u8 *data = (handle >= 0) ? vfs_get_data(handle, &data_len) : NULL;
+		if (data != NULL) {
+			loads_hash = posix_hash_bytes(posix_hash_str(loads_hash, type), data, data_len);
+			if (zzt_load_asset(type, data, data_len) < 0) {
+				fprintf(stderr, "Could not load %s!\n", filename);
+			}
+			vfs_close(handle);
+			continue;
+		}
+		if (handle >= 0) vfs_close(handle);
+
 		FILE *file = fopen(filename, "rb");
 		if (!file) {
 			fprintf(stderr, "Could not open %s!\n", filename);
@@ -180,6 +511,7 @@ static int posix_zzt_init(int argc, char **argv) {
 
 		fclose(file);
 
+		loads_hash = posix_hash_bytes(posix_hash_str(loads_hash, type), buffer, (int) fsize);
 		if (zzt_load_asset(type, buffer, (int) fsize) < 0) {
 			fprintf(stderr, "Could not load %s!\n", filename);
 		}
@@ -187,6 +519,52 @@ static int posix_zzt_init(int argc, char **argv) {
 		free(buffer);
 	}
 
+	strncpy(posix_world_name, arg_name, 256);
+
+	// the atlas changes how the world is loaded, which the cache skips
+	if (cache_dir != NULL && posix_zzt_arg_atlas_dir == NULL) {
+		// key: engine binaries, memory size, world file, assets, other settings
+		u64 h = FNV64_OFFSET;
+		u8 key_ints[3] = { ZZT_SNAPSHOT_VERSION, skip_kc, 0 };
+		int cache_kbs = memory_kbs < 0 ? MAX_MEMORY_KBS : memory_kbs;
+		int cache_keybuf_size = zzt_key_get_buffer_size();
+
+		h = posix_hash_bytes(h, key_ints, sizeof(key_ints));
+		h = posix_hash_bytes(h, (u8*) &cache_kbs, sizeof(cache_kbs));
+		h = posix_hash_bytes(h, (u8*) &cache_keybuf_size, sizeof(cache_keybuf_size));
+		// the assets as loaded, as the snapshot holds the charset and palette
+		h = posix_hash_bytes(h, (u8*) &loads_hash, sizeof(loads_hash));
+		for (int i = 0; i < exec_count; i++) {
+			strncpy(exec_name, execs[i], 256);
+			exec_name[256] = 0;
+			char *space_ptr = strchr(exec_name, ' ');
+			if (space_ptr != NULL) space_ptr[0] = '\0';
+			h = posix_hash_str(h, execs[i]);
+			h = posix_hash_file(h, exec_name);
+		}
+		if (exec_count == 0) {
+			h = posix_hash_file(h, posix_vfs_exists("zzt.exe") ? "zzt.exe" : "superz.exe");
+		}
+		if (arg_name[0] != 0) {
+			h = posix_hash_file(h, arg_name);
+		}
+
+		snprintf(posix_boot_cache_path, sizeof(posix_boot_cache_path), "%s/zeta-%016llx.snp", cache_dir, (unsigned long long) h);
+		if (posix_boot_cache_load() >= 0) {
+			// the engine loaded the world before the snapshot was taken
+			int worldh = (arg_name[0] != 0) ? vfs_open(arg_name, 0) : -1;
+			if (worldh >= 0) {
+				u8 header[ZZT_OBSERVE_WORLD_HEADER_SIZE];
+				int header_len = vfs_read(worldh, header, sizeof(header));
+				zzt_observe_locate_world(header, header_len);
+				vfs_close(worldh);
+			}
+			zzt_set_timer_offset((time(NULL) % 86400) * 1000L);
+			return 0;
+		}
+		posix_boot_cache_pending = 1;
+	}
+
 	if (exec_count > 0) {
 		int exeh = 0;
 		for (int i = 0; i < exec_count; i++) {
@@ -201,16 +579,24 @@ static int posix_zzt_init(int argc, char **argv) {
 				}
 				space_ptr[0] = ' ';
 				fprintf(stderr, "'%s'\n", space_ptr + 1);
-				zzt_load_binary(exeh, space_ptr + 1);
+				int result = zzt_load_binary(exeh, space_ptr + 1);
 				vfs_close(exeh);
+				if (result < 0) {
+					fprintf(stderr, "Could not load %s!\n", execs[i]);
+					return -1;
+				}
 			} else {
 				exeh = vfs_open(execs[i], 0);
 				if (exeh < 0) {
 					fprintf(stderr, "Could not load %s!\n", execs[i]);
 					return -1;
 				}
-				zzt_load_binary(exeh, (i == exec_count - 1) ? arg_name : NULL);
+				int result = zzt_load_binary(exeh, (i == exec_count - 1) ? arg_name : NULL);
 				vfs_close(exeh);
+				if (result < 0) {
+					fprintf(stderr, "Could not load %s!\n", execs[i]);
+					return -1;
+				}
 			}
 
 			// last binary is engine
@@ -223,8 +609,10 @@ static int posix_zzt_init(int argc, char **argv) {
 			exeh = vfs_open("superz.exe", 0);
 		if (exeh < 0)
 			return -1;
-		zzt_load_binary(exeh, arg_name);
+		int result = zzt_load_binary(exeh, arg_name);
 		vfs_close(exeh);
+		if (result < 0)
+			return -1;
 	}
 
 	zzt_set_timer_offset((time(NULL) % 86400) * 1000L);
@@ -239,3 +627,130 @@ static int posix_zzt_init(int argc, char **argv) {
 	}
 	return 0;
 }
+
+// board atlas - each board is shown by having the engine load the world
+// with that board as the starting one, then starting play from the title
+// screen; the emulator is a single instance, so workers are processes
+
+#define POSIX_ATLAS_TICK_LIMIT 2000 /* timer ticks, about two minutes */
+
+// runs the engine until it polls an empty keyboard buffer
+static int posix_atlas_run_idle(void) {
+	int idle_count = zzt_kbd_idle_count();
+	int ticks = 0;
+
+	while (ticks < POSIX_ATLAS_TICK_LIMIT) {
+		int rcode = zzt_execute(64000);
+		posix_zzt_log_drain();
+		if (rcode == STATE_END) return -1;
+		if (zzt_kbd_idle_count() != idle_count) return 0;
+		if (rcode == STATE_WAIT) {
+			zzt_mark_timer_turbo();
+			ticks++;
+		}
+	}
+	return -1;
+}
+
+static int posix_atlas_board(int board, const u8 *boot, int boot_len, u8 *charset, int charw, int charh, u32 *palette) {
+	char filename[1040];
+	zzt_game_state state;
+
+	if (zzt_snapshot_load(boot, boot_len) < 0) return -1;
+	zzt_set_start_board(board);
+
+	// title screen, then play
+	if (posix_atlas_run_idle() < 0) return -1;
+	zzt_key('p', 0x19);
+	zzt_keyup(0x19);
+	if (posix_atlas_run_idle() < 0) return -1;
+	if (!(zzt_observe(&state) & ZZT_OBSERVE_WORLD) || state.board_id != board) return -1;
+
+#ifdef USE_LIBPNG
+	int stype = SCREENSHOT_TYPE_PNG;
+	snprintf(filename, sizeof(filename), "%s/board%03d.png", posix_zzt_arg_atlas_dir, board);
+#else
+	int stype = SCREENSHOT_TYPE_BMP;
+	snprintf(filename, sizeof(filename), "%s/board%03d.bmp", posix_zzt_arg_atlas_dir, board);
+#endif
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL) return -1;
+	int result = write_screenshot(
+		file, stype,
+		(zzt_video_mode() & 2) ? 80 : 40, video_blink ? 0 : RENDER_BLINK_OFF,
+		zzt_get_ram() + 0xB8000, charset,
+		charw, charh,
+		palette
+	);
+	if (fclose(file) != 0) result = -1;
+	return result < 0 ? -1 : 0;
+}
+
+static int posix_atlas_worker(int worker, int board_count, const u8 *boot, int boot_len, u8 *charset, int charw, int charh, u32 *palette) {
+	int failed = 0;
+
+	for (int i = worker; i < board_count; i += posix_atlas_workers) {
+		if (posix_atlas_board(i, boot, boot_len, charset, charw, charh, palette) < 0) {
+			fprintf(stderr, "Could not render board %d!\n", i);
+			failed++;
+		}
+	}
+	return failed;
+}
+
+// to be called by the frontend after posix_zzt_init, instead of running
+// the engine; returns the process exit code
+static int posix_zzt_atlas(u8 *charset, int charw, int charh, u32 *palette) {
+	u8 header[4];
+	int failed = 0;
+
+	int worldh = posix_world_name[0] != 0 ? vfs_open(posix_world_name, 0) : -1;
+	int header_len = worldh >= 0 ? vfs_read(worldh, header, sizeof(header)) : -1;
+	if (worldh >= 0) vfs_close(worldh);
+	if (header_len != sizeof(header) || header[0] != 0xFF || header[1] != 0xFF) {
+		fprintf(stderr, "Could not read world header!\n");
+		return 1;
+	}
+	int board_count = (header[2] | (header[3] << 8)) + 1;
+
+	// every board starts from the engine as loaded, before it runs
+	u8 *boot = (u8*) malloc(ZZT_SNAPSHOT_MAX_SIZE);
+	int boot_len = zzt_snapshot_save(boot, ZZT_SNAPSHOT_MAX_SIZE);
+	if (boot_len < 0) {
+		fprintf(stderr, "Could not create boot snapshot!\n");
+		free(boot);
+		return 1;
+	}
+	zzt_set_speed(ZZT_SPEED_UNLIMITED, ZZT_SPEED_AUDIO_MUTE);
+
+	if (posix_atlas_workers > board_count) posix_atlas_workers = board_count;
+#ifdef _WIN32
+	posix_atlas_workers = 1;
+#else
+	if (posix_atlas_workers > 1) {
+		pid_t pids[64];
+
+		fflush(stderr);
+		for (int i = 0; i < posix_atlas_workers; i++) {
+			pids[i] = fork();
+			if (pids[i] == 0) {
+				_exit(posix_atlas_worker(i, board_count, boot, boot_len, charset, charw, charh, palette) > 0 ? 1 : 0);
+			} else if (pids[i] < 0) {
+				// render the boards of workers which could not start here
+				failed += posix_atlas_worker(i, board_count, boot, boot_len, charset, charw, charh, palette);
+			}
+		}
+		for (int i = 0; i < posix_atlas_workers; i++) {
+			int status;
+			if (pids[i] > 0 && (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+				failed++;
+			}
+		}
+		free(boot);
+		return failed > 0 ? 1 : 0;
+	}
+#endif
+	failed = posix_atlas_worker(0, board_count, boot, boot_len, charset, charw, charh, palette);
+	free(boot);
+	return failed > 0 ? 1 : 0;
+}
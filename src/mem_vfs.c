@@ -0,0 +1,282 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef NO_OPENDIR
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#ifndef NO_OPENDIR
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+#include "mem_vfs.h"
+#include "vfs_util.h"
+#ifdef USE_ZLIB
+#include "zip_vfs.h"
+#endif
+
+#define MEM_MAX_NAME 259
+
+typedef struct {
+	char *name;
+	u32 hash; // of the case-folded name
+	long offset;
+	int size;
+	u32 dos_time; // date << 16 | time
+} mem_entry;
+
+struct mem_bundle {
+	char path[MEM_MAX_NAME + 1];
+	int refs;
+	mem_bundle *next;
+
+	u8 *arena; // the contents of all entries
+	long arena_size;
+	char *names; // one allocation for all entry names
+	mem_entry *entries;
+	int entry_count;
+	int *table; // entry ID + 1, or 0 if empty
+	int table_mask;
+};
+
+// bundles currently open, so that they can be shared
+static mem_bundle *mem_bundles = NULL;
+#ifdef USE_PTHREADS
+static pthread_mutex_t mem_bundles_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void mem_bundle_free(mem_bundle *bundle) {
+	free(bundle->arena);
+	free(bundle->names);
+	free(bundle->entries);
+	free(bundle->table);
+	free(bundle);
+}
+
+// sizes and names are filled in first, then the arena is allocated at once
+static int mem_bundle_alloc(mem_bundle *bundle, int count, long names_size) {
+	bundle->entries = malloc(sizeof(mem_entry) * (count > 0 ? count : 1));
+	bundle->names = malloc(names_size > 0 ? names_size : 1);
+	return (bundle->entries == NULL || bundle->names == NULL) ? -1 : 0;
+}
+
+static int mem_bundle_add(mem_bundle *bundle, const char *name, long *names_pos, int size, u32 dos_time) {
+	mem_entry *e = &bundle->entries[bundle->entry_count++];
+	e->name = bundle->names + *names_pos;
+	strcpy(e->name, name);
+	*names_pos += strlen(name) + 1;
+	e->offset = bundle->arena_size;
+	e->size = size;
+	e->dos_time = dos_time;
+	if (bundle->arena_size + size > 0x7FFFFFFFL) return -1;
+	bundle->arena_size += size;
+	return 0;
+}
+
+#ifdef USE_ZLIB
+static int mem_bundle_read_zip(mem_bundle *bundle, zip_archive *zip) {
+	long names_size = 0, names_pos = 0;
+	int count = zip_entry_count(zip);
+
+	for (int i = 0; i < count; i++) {
+		names_size += strlen(zip_entry_name(zip, i)) + 1;
+	}
+	if (mem_bundle_alloc(bundle, count, names_size) < 0) return -1;
+	for (int i = 0; i < count; i++) {
+		if (mem_bundle_add(bundle, zip_entry_name(zip, i), &names_pos, zip_entry_size(zip, i), zip_entry_dos_time(zip, i)) < 0) return -1;
+	}
+
+	bundle->arena = malloc(bundle->arena_size > 0 ? bundle->arena_size : 1);
+	if (bundle->arena == NULL) return -1;
+	for (int i = 0; i < count; i++) {
+		if (zip_entry_unpack(zip, i, bundle->arena + bundle->entries[i].offset) < 0) return -1;
+	}
+	return 0;
+}
+#endif
+
+#ifndef NO_OPENDIR
+// regular files only; subdirectories are not descended into
+static int mem_bundle_read_dir(mem_bundle *bundle, DIR *dir) {
+	struct dirent *entry;
+	struct stat st;
+	char path[MEM_MAX_NAME * 2 + 2];
+	long names_size = 0, names_pos = 0;
+	int count = 0;
+
+	while ((entry = readdir(dir)) != NULL) {
+		count++;
+		names_size += strlen(entry->d_name) + 1;
+	}
+	if (mem_bundle_alloc(bundle, count, names_size) < 0) return -1;
+
+	rewinddir(dir);
+	while ((entry = readdir(dir)) != NULL && bundle->entry_count < count) {
+		snprintf(path, sizeof(path), "%s/%s", bundle->path, entry->d_name);
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size >= 0x7FFFFFFF) continue;
+		if (names_pos + strlen(entry->d_name) + 1 > names_size) break;
+		if (mem_bundle_add(bundle, entry->d_name, &names_pos, st.st_size, vfs_dos_time(st.st_mtime)) < 0) return -1;
+	}
+
+	bundle->arena = malloc(bundle->arena_size > 0 ? bundle->arena_size : 1);
+	if (bundle->arena == NULL) return -1;
+	for (int i = 0; i < bundle->entry_count; i++) {
+		mem_entry *e = &bundle->entries[i];
+		snprintf(path, sizeof(path), "%s/%s", bundle->path, e->name);
+		FILE *file = fopen(path, "rb");
+		if (file == NULL) return -1;
+		// a file which shrank since is cut short
+		e->size = fread(bundle->arena + e->offset, 1, e->size, file);
+		fclose(file);
+	}
+	return 0;
+}
+#endif
+
+static int mem_bundle_read(mem_bundle *bundle) {
+	int result = -1;
+
+#ifndef NO_OPENDIR
+	DIR *dir = opendir(bundle->path);
+	if (dir != NULL) {
+		result = mem_bundle_read_dir(bundle, dir);
+		closedir(dir);
+	} else
+#endif
+	{
+#ifdef USE_ZLIB
+		zip_archive *zip = zip_archive_open(bundle->path);
+		if (zip != NULL) {
+			result = mem_bundle_read_zip(bundle, zip);
+			zip_archive_close(zip);
+		}
+#endif
+	}
+	if (result < 0) return -1;
+
+	// the table is kept at most half full
+	int table_size = 16;
+	while (table_size < bundle->entry_count * 2) table_size *= 2;
+	bundle->table = calloc(table_size, sizeof(int));
+	if (bundle->table == NULL) return -1;
+	bundle->table_mask = table_size - 1;
+
+	for (int i = 0; i < bundle->entry_count; i++) {
+		mem_entry *e = &bundle->entries[i];
+		e->hash = vfs_name_hash(e->name);
+		int pos = e->hash & bundle->table_mask;
+		while (bundle->table[pos] != 0) pos = (pos + 1) & bundle->table_mask;
+		bundle->table[pos] = i + 1;
+	}
+	return 0;
+}
+
+mem_bundle *mem_bundle_open(const char *path) {
+	mem_bundle *bundle;
+
+	if (strlen(path) > MEM_MAX_NAME) return NULL;
+
+#ifdef USE_PTHREADS
+	pthread_mutex_lock(&mem_bundles_lock);
+#endif
+	for (bundle = mem_bundles; bundle != NULL; bundle = bundle->next) {
+		if (strcmp(bundle->path, path) == 0) {
+			bundle->refs++;
+			break;
+		}
+	}
+	if (bundle == NULL) {
+		bundle = calloc(1, sizeof(mem_bundle));
+		if (bundle != NULL) {
+			strcpy(bundle->path, path);
+			if (mem_bundle_read(bundle) < 0) {
+				mem_bundle_free(bundle);
+				bundle = NULL;
+			} else {
+				bundle->refs = 1;
+				bundle->next = mem_bundles;
+				mem_bundles = bundle;
+			}
+		}
+	}
+#ifdef USE_PTHREADS
+	pthread_mutex_unlock(&mem_bundles_lock);
+#endif
+	return bundle;
+}
+
+void mem_bundle_close(mem_bundle *bundle) {
+#ifdef USE_PTHREADS
+	pthread_mutex_lock(&mem_bundles_lock);
+#endif
+	if (--bundle->refs == 0) {
+		mem_bundle **prev = &mem_bundles;
+		while (*prev != bundle) prev = &(*prev)->next;
+		*prev = bundle->next;
+		mem_bundle_free(bundle);
+	}
+#ifdef USE_PTHREADS
+	pthread_mutex_unlock(&mem_bundles_lock);
+#endif
+}
+
+long mem_bundle_size(mem_bundle *bundle) {
+	return bundle->arena_size;
+}
+
+int mem_entry_count(mem_bundle *bundle) {
+	return bundle->entry_count;
+}
+
+const char *mem_entry_name(mem_bundle *bundle, int id) {
+	return bundle->entries[id].name;
+}
+
+int mem_entry_find(mem_bundle *bundle, const char *name) {
+	u32 hash = vfs_name_hash(name);
+	int pos = hash & bundle->table_mask;
+
+	while (bundle->table[pos] != 0) {
+		mem_entry *e = &bundle->entries[bundle->table[pos] - 1];
+		if (e->hash == hash && strcasecmp(e->name, name) == 0) return bundle->table[pos] - 1;
+		pos = (pos + 1) & bundle->table_mask;
+	}
+	return -1;
+}
+
+u32 mem_entry_dos_time(mem_bundle *bundle, int id) {
+	return bundle->entries[id].dos_time;
+}
+
+const u8 *mem_entry_data(mem_bundle *bundle, int id, int *len) {
+	*len = bundle->entries[id].size;
+	return bundle->arena + bundle->entries[id].offset;
+}
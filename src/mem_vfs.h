@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef __MEM_VFS_H__
+#define __MEM_VFS_H__
+
+#include "types.h"
+
+// read-only file bundles, held in memory: every file of a directory, or
+// every member of a ZIP archive, is read into one arena when the bundle
+// is opened, after which no further I/O is done. Bundles opened from the
+// same path are shared within the process, and freed on the last close
+
+typedef struct mem_bundle mem_bundle;
+
+mem_bundle *mem_bundle_open(const char *path);
+void mem_bundle_close(mem_bundle *bundle);
+long mem_bundle_size(mem_bundle *bundle);
+
+int mem_entry_count(mem_bundle *bundle);
+const char *mem_entry_name(mem_bundle *bundle, int id);
+// case-insensitive; returns an entry ID, or -1 if not found
+int mem_entry_find(mem_bundle *bundle, const char *name);
+// modification time, DOS date in the upper word and time in the lower
+u32 mem_entry_dos_time(mem_bundle *bundle, int id);
+// valid until the bundle is closed
+const u8 *mem_entry_data(mem_bundle *bundle, int id, int *len);
+
+#endif /* __MEM_VFS_H__ */
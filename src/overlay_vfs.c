@@ -0,0 +1,363 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "overlay_vfs.h"
+#include "vfs_util.h"
+
+#define OVERLAY_MAX_NAME 259
+
+typedef struct {
+	char name[OVERLAY_MAX_NAME + 1];
+	u8 *data;
+	int size, capacity;
+	int dirty;
+} overlay_file;
+
+struct overlay_store {
+	char directory[OVERLAY_MAX_NAME + 1];
+	int flush_ms, sync_mode;
+
+	// files are only added, so IDs stay valid; the lock is held by the
+	// emulation thread while changing files, and by the flush thread
+	// while taking copies of them
+	overlay_file *files;
+	int file_count, file_size;
+	int dirty_count;
+	int flush_requests, flush_done;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int threaded, stop;
+};
+
+typedef struct {
+	int id;
+	char name[OVERLAY_MAX_NAME + 1];
+	u8 *data;
+	int size;
+} overlay_batch_entry;
+
+static int overlay_save(overlay_store *store, const char *name, const u8 *data, int size) {
+	char path[OVERLAY_MAX_NAME * 2 + 8];
+
+	snprintf(path, sizeof(path), "%s/%s", store->directory, name);
+	return vfs_write_file(path, data, size, store->sync_mode == OVERLAY_SYNC_FILE);
+}
+
+// to be called with the lock held; returns with the lock held
+static void overlay_flush_batch(overlay_store *store) {
+	overlay_batch_entry *batch;
+	int count = 0;
+
+	if (store->dirty_count == 0) return;
+	batch = malloc(sizeof(overlay_batch_entry) * store->dirty_count);
+	if (batch == NULL) return;
+
+	for (int i = 0; i < store->file_count; i++) {
+		overlay_file *f = &store->files[i];
+		if (!f->dirty) continue;
+		u8 *copy = malloc(f->size > 0 ? f->size : 1);
+		if (copy == NULL) continue;
+		memcpy(copy, f->data, f->size);
+		batch[count].id = i;
+		strcpy(batch[count].name, f->name);
+		batch[count].data = copy;
+		batch[count].size = f->size;
+		count++;
+		f->dirty = 0;
+		store->dirty_count--;
+	}
+
+	pthread_mutex_unlock(&store->lock);
+	for (int i = 0; i < count; i++) {
+		if (overlay_save(store, batch[i].name, batch[i].data, batch[i].size) < 0) {
+			fprintf(stderr, "Could not save %s!\n", batch[i].name);
+			batch[i].size = -1;
+		}
+		free(batch[i].data);
+	}
+	pthread_mutex_lock(&store->lock);
+
+	// failed saves are retried with the next batch
+	for (int i = 0; i < count; i++) {
+		overlay_file *f = &store->files[batch[i].id];
+		if (batch[i].size < 0 && !f->dirty) {
+			f->dirty = 1;
+			store->dirty_count++;
+		}
+	}
+	free(batch);
+}
+
+static void overlay_deadline(struct timespec *ts, int ms) {
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (long) (ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static void *overlay_flush_thread(void *arg) {
+	overlay_store *store = (overlay_store*) arg;
+	struct timespec deadline;
+
+	pthread_mutex_lock(&store->lock);
+	while (!store->stop) {
+		while (!store->stop && store->dirty_count == 0 && store->flush_requests == store->flush_done) {
+			pthread_cond_wait(&store->cond, &store->lock);
+		}
+
+		// wait out the interval, so that changes made meanwhile
+		// are saved together
+		int requests = store->flush_requests;
+		if (!store->stop && requests == store->flush_done) {
+			overlay_deadline(&deadline, store->flush_ms);
+			while (!store->stop && store->flush_requests == store->flush_done
+				&& pthread_cond_timedwait(&store->cond, &store->lock, &deadline) == 0) { }
+			requests = store->flush_requests;
+		}
+
+		overlay_flush_batch(store);
+		store->flush_done = requests;
+		pthread_cond_broadcast(&store->cond);
+	}
+	overlay_flush_batch(store);
+	pthread_mutex_unlock(&store->lock);
+	return NULL;
+}
+
+overlay_store *overlay_store_open(const char *directory, int flush_ms, int sync_mode) {
+	// saving would only fail later, in the background
+	if (directory != NULL) {
+		struct stat st;
+		if (strlen(directory) > OVERLAY_MAX_NAME || stat(directory, &st) != 0
+			|| !S_ISDIR(st.st_mode) || access(directory, W_OK) != 0) return NULL;
+	}
+
+	overlay_store *store = calloc(1, sizeof(overlay_store));
+	if (store == NULL) return NULL;
+
+	if (directory != NULL) strncpy(store->directory, directory, OVERLAY_MAX_NAME);
+	store->flush_ms = flush_ms;
+	store->sync_mode = sync_mode;
+	pthread_mutex_init(&store->lock, NULL);
+	pthread_cond_init(&store->cond, NULL);
+	if (directory == NULL) return store;
+
+	store->threaded = 1;
+	if (pthread_create(&store->thread, NULL, overlay_flush_thread, store) != 0) {
+		pthread_cond_destroy(&store->cond);
+		pthread_mutex_destroy(&store->lock);
+		free(store);
+		return NULL;
+	}
+	return store;
+}
+
+overlay_store *overlay_store_copy(overlay_store *store) {
+	overlay_store *copy = overlay_store_open(NULL, 0, OVERLAY_SYNC_NONE);
+	if (copy == NULL) return NULL;
+
+	// the flush thread only reads files, and clears dirty flags
+	pthread_mutex_lock(&store->lock);
+	copy->files = malloc(sizeof(overlay_file) * (store->file_count > 0 ? store->file_count : 1));
+	if (copy->files != NULL) {
+		copy->file_size = store->file_count > 0 ? store->file_count : 1;
+		for (; copy->file_count < store->file_count; copy->file_count++) {
+			overlay_file *f = &store->files[copy->file_count];
+			overlay_file *fc = &copy->files[copy->file_count];
+			*fc = *f;
+			fc->capacity = f->size > 0 ? f->size : 16;
+			fc->data = malloc(fc->capacity);
+			if (fc->data == NULL) break;
+			memcpy(fc->data, f->data, f->size);
+			if (fc->dirty) copy->dirty_count++;
+		}
+	}
+	int failed = copy->files == NULL || copy->file_count < store->file_count;
+	pthread_mutex_unlock(&store->lock);
+
+	if (failed) {
+		overlay_store_close(copy);
+		return NULL;
+	}
+	return copy;
+}
+
+void overlay_store_close(overlay_store *store) {
+	if (store->threaded) {
+		pthread_mutex_lock(&store->lock);
+		store->stop = 1;
+		pthread_cond_broadcast(&store->cond);
+		pthread_mutex_unlock(&store->lock);
+		pthread_join(store->thread, NULL);
+	}
+
+	for (int i = 0; i < store->file_count; i++) {
+		free(store->files[i].data);
+	}
+	free(store->files);
+	pthread_cond_destroy(&store->cond);
+	pthread_mutex_destroy(&store->lock);
+	free(store);
+}
+
+void overlay_store_flush(overlay_store *store) {
+	if (!store->threaded) return;
+	pthread_mutex_lock(&store->lock);
+	int request = ++store->flush_requests;
+	pthread_cond_broadcast(&store->cond);
+	while (store->flush_done - request < 0) {
+		pthread_cond_wait(&store->cond, &store->lock);
+	}
+	pthread_mutex_unlock(&store->lock);
+}
+
+const char *overlay_store_directory(overlay_store *store) {
+	return store->directory;
+}
+
+int overlay_file_count(overlay_store *store) {
+	return store->file_count;
+}
+
+const char *overlay_file_name(overlay_store *store, int id) {
+	return store->files[id].name;
+}
+
+int overlay_file_find(overlay_store *store, const char *name) {
+	for (int i = 0; i < store->file_count; i++) {
+		if (strcasecmp(store->files[i].name, name) == 0) return i;
+	}
+	return -1;
+}
+
+static void overlay_mark_dirty(overlay_store *store, overlay_file *f) {
+	if (!f->dirty) {
+		f->dirty = 1;
+		if (store->dirty_count++ == 0) pthread_cond_broadcast(&store->cond);
+	}
+}
+
+int overlay_file_create(overlay_store *store, const char *name, const u8 *data, int len) {
+	if (strlen(name) > OVERLAY_MAX_NAME) return -1;
+
+	pthread_mutex_lock(&store->lock);
+	if (store->file_count >= store->file_size) {
+		int size_new = store->file_size > 0 ? store->file_size * 2 : 16;
+		overlay_file *files_new = realloc(store->files, sizeof(overlay_file) * size_new);
+		if (files_new == NULL) {
+			pthread_mutex_unlock(&store->lock);
+			return -1;
+		}
+		store->files = files_new;
+		store->file_size = size_new;
+	}
+
+	overlay_file *f = &store->files[store->file_count];
+	strcpy(f->name, name);
+	f->capacity = len > 0 ? len : 16;
+	f->data = malloc(f->capacity);
+	if (f->data == NULL) {
+		pthread_mutex_unlock(&store->lock);
+		return -1;
+	}
+	if (len > 0) memcpy(f->data, data, len);
+	f->size = len;
+	f->dirty = 0;
+	int id = store->file_count++;
+	pthread_mutex_unlock(&store->lock);
+	return id;
+}
+
+int overlay_file_size(overlay_store *store, int id) {
+	return store->files[id].size;
+}
+
+int overlay_file_written(overlay_store *store, int id) {
+	pthread_mutex_lock(&store->lock);
+	int dirty = store->files[id].dirty;
+	pthread_mutex_unlock(&store->lock);
+	return dirty;
+}
+
+// only the emulation thread changes files, so it reads without the lock
+int overlay_file_read(overlay_store *store, int id, long pos, u8 *ptr, int amount) {
+	overlay_file *f = &store->files[id];
+	long avail = f->size - pos;
+
+	if (amount > avail) amount = avail > 0 ? avail : 0;
+	if (amount > 0) memcpy(ptr, f->data + pos, amount);
+	return amount;
+}
+
+int overlay_file_write(overlay_store *store, int id, long pos, const u8 *ptr, int amount) {
+	overlay_file *f = &store->files[id];
+	long end = pos + amount;
+
+	if (amount <= 0) return 0;
+	if (end > 0x7FFFFFFF) return -1;
+
+	pthread_mutex_lock(&store->lock);
+	if (end > f->capacity) {
+		int capacity_new = f->capacity;
+		while (capacity_new < end) capacity_new = capacity_new < 0x40000000 ? capacity_new * 2 : 0x7FFFFFFF;
+		u8 *data_new = realloc(f->data, capacity_new);
+		if (data_new == NULL) {
+			pthread_mutex_unlock(&store->lock);
+			return -1;
+		}
+		f->data = data_new;
+		f->capacity = capacity_new;
+	}
+	// writing past the end leaves a gap of zeroes
+	if (pos > f->size) memset(f->data + f->size, 0, pos - f->size);
+	memcpy(f->data + pos, ptr, amount);
+	if (end > f->size) f->size = end;
+	overlay_mark_dirty(store, f);
+	pthread_mutex_unlock(&store->lock);
+	return amount;
+}
+
+void overlay_file_truncate(overlay_store *store, int id) {
+	pthread_mutex_lock(&store->lock);
+	store->files[id].size = 0;
+	overlay_mark_dirty(store, &store->files[id]);
+	pthread_mutex_unlock(&store->lock);
+}
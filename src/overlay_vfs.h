@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __OVERLAY_VFS_H__
+#define __OVERLAY_VFS_H__
+
+#include "types.h"
+
+// written files, kept in memory and saved to a directory in the
+// background; the emulation thread only ever touches memory. Changes
+// are saved in batches, at most once per flush interval
+#define OVERLAY_FLUSH_DEFAULT_MS 1000
+#define OVERLAY_SYNC_NONE 0
+#define OVERLAY_SYNC_FILE 1 /* fsync every saved file */
+
+typedef struct overlay_store overlay_store;
+
+// with a NULL directory, files are only ever kept in memory; fails if
+// the directory does not exist or is not writable
+overlay_store *overlay_store_open(const char *directory, int flush_ms, int sync_mode);
+// a copy of the files, kept in memory only; files written in store
+// and not saved yet count as written in the copy. NULL on error
+overlay_store *overlay_store_copy(overlay_store *store);
+// saves all changes, then frees the store
+void overlay_store_close(overlay_store *store);
+// blocks until all changes made so far are saved
+void overlay_store_flush(overlay_store *store);
+
+// empty if not saving
+const char *overlay_store_directory(overlay_store *store);
+int overlay_file_count(overlay_store *store);
+const char *overlay_file_name(overlay_store *store, int id);
+// case-insensitive; returns a file ID, or -1 if not found
+int overlay_file_find(overlay_store *store, const char *name);
+// returns a file ID; data may be NULL for an empty file. The file is
+// only saved once written to or truncated
+int overlay_file_create(overlay_store *store, const char *name, const u8 *data, int len);
+
+int overlay_file_size(overlay_store *store, int id);
+// whether the file was written to or truncated since it was created, or
+// last saved; files kept in memory only are never saved
+int overlay_file_written(overlay_store *store, int id);
+int overlay_file_read(overlay_store *store, int id, long pos, u8 *ptr, int amount);
+int overlay_file_write(overlay_store *store, int id, long pos, const u8 *ptr, int amount);
+void overlay_file_truncate(overlay_store *store, int id);
+
+#endif /* __OVERLAY_VFS_H__ */
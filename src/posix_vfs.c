@@ -27,243 +27,1964 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
+#include <sys/stat.h>
 #include "zzt.h"
+#include "posix_vfs.h"
+#include "mem_vfs.h"
+#include "vfs_util.h"
+#ifdef USE_ZLIB
+#include "cas_vfs.h"
+#include "zip_vfs.h"
+#endif
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#include "overlay_vfs.h"
+#include "prefetch_vfs.h"
+#endif
+
+// files opened for reading are copied into memory rather than mapped, once
+// their data is asked for: a mapping faults with SIGBUS once the file is
+// truncated behind it
+#if defined(__unix__) || defined(__APPLE__)
+#define POSIX_VFS_READ_COPY
+#define POSIX_VFS_READ_COPY_MAX (16 << 20)
+#endif
 
 #ifndef NO_OPENDIR
 #include <dirent.h>
-#include <strings.h>
+#include <unistd.h>
+#ifdef __linux__
+#define POSIX_VFS_INOTIFY
+#include <sys/inotify.h>
+#endif
+#endif
+
+#ifdef USE_PTHREADS
+#define VFS_THREAD_LOCAL _Thread_local
+#else
+#define VFS_THREAD_LOCAL
 #endif
 
 #define MAX_FNLEN 259
-#define MAX_SPECLEN 16
+// handle tables start out with MAX_FILES slots, and double as needed;
+// snapshots store slot numbers in a byte
+#define VFS_MAX_HANDLES 256
+// reads continuing where the previous one ended, before a file is read ahead
+#define VFS_PREFETCH_SEQ_READS 2
+#define VFS_INDEX_EXT_BUCKETS 64
+
+typedef struct {
+	FILE* file;
+	char name[MAX_FNLEN+1];
+	int mode;
+	int used;
+	int next_free; // next slot in the free list, or -1
+	// files opened for reading are copied into map, and read from there;
+	// pos is also used for overlay files
+	u8* map;
+	long map_size, pos;
+	// ZIP archive entries, either unpacked by the archive or mapped from
+	// the shared store, memory bundle entries and overlay files, or -1;
+	// all but the last have no FILE, only the mapping, the last neither
+	int zip_id, cas_id, mem_id, overlay_id;
+	int stat_id; // in file_stats
+	// files on disk opened for reading: read through stdio until read
+	// ahead or until their data is asked for, then the mapping holds the
+	// read-ahead copy or a private one
+	long file_size;
+	s64 file_mtime; // in nanoseconds
+	int prefetch_id; // or -1
+	int prefetch_pending;
+	int seq_reads;
+	long read_end;
+} vfs_handle;
+
+// DOS file attributes
+#define VFS_ATTR_READONLY 0x01
+#define VFS_ATTR_HIDDEN 0x02
+#define VFS_ATTR_SYSTEM 0x04
+#define VFS_ATTR_VOLUME 0x08
+#define VFS_ATTR_DIRECTORY 0x10
+#define VFS_ATTR_ARCHIVE 0x20
+
+// where an index entry's file is read from
+#define VFS_SOURCE_DISK 0
+#define VFS_SOURCE_SAVED 1 /* the overlay's directory */
+#define VFS_SOURCE_OVERLAY 2
+#define VFS_SOURCE_ZIP 3
+#define VFS_SOURCE_MEM 4
+
+// how much of an index entry's stat snapshot is filled in
+#define VFS_STAT_NONE 0
+#define VFS_STAT_TYPE 1 /* attr, from the listing */
+#define VFS_STAT_FULL 2
+
+typedef struct {
+	u32 name; // offset in index_names
+	u32 hash; // of the case-folded name
+	int ext_next; // next entry in the same extension bucket, or -1
+	u8 source, stat_state, attr;
+	u32 size, dos_time; // DOS date << 16 | time
+} vfs_index_entry;
+
+#ifdef USE_PTHREADS
+// the files of a fork of the emulator, see vfs_fork_create()
+typedef struct {
+	overlay_store *overlay; // NULL if unused
+	u8 *handles; // as saved by posix_vfs_save_handles()
+	int handles_len;
+} vfs_fork;
+#endif
+
+struct vfs_context {
+	vfs_handle *handles;
+	int handle_count;
+	int free_first; // first free slot, or -1
+	char fnbuf[MAX_FNLEN+1];
+	char fndir[MAX_FNLEN+1];
+	int fnprefsize;
+
+	// directory index - the entries of fndir, read once and kept until
+	// the directory changes, so that case fixing on open is a hash lookup
+	// and listing "*.EXT" only visits the files with that extension. Changes
+	// are noticed with inotify where available, and with the directory's
+	// modification time elsewhere
+	vfs_index_entry *index_entries;
+	int index_count, index_size;
+	char *index_names;
+	u32 index_names_len, index_names_size;
+	int *index_table; // entry index + 1, or 0 if empty
+	int index_table_mask, index_table_size;
+	int index_ext_first[VFS_INDEX_EXT_BUCKETS];
+	int index_valid;
+	int index_generation;
+#ifdef POSIX_VFS_INOTIFY
+	int index_inotify;
+	pid_t index_inotify_pid;
+#endif
+	time_t index_mtime, index_time;
+
+	u8 find_pattern[11]; // blank-padded 8.3, see vfs_find_pattern()
+	u8 find_mask;
+	int find_pos;
+	int find_bucketed;
+	int find_generation;
+
+	// when set, replaces fndir and the archive: files are only read
+	// from the bundle, without touching the disk
+	mem_bundle *mem;
+#ifdef USE_ZLIB
+	// files not found on disk are looked up in the archive
+	zip_archive *zip;
+#endif
+#ifdef USE_PTHREADS
+	// files opened for writing are copied to memory, and saved to the
+	// overlay's directory in the background; files saved there shadow
+	// the ones in fndir. A private overlay, saved nowhere, takes the
+	// writes to a memory bundle
+	overlay_store *overlay;
+	int overlay_private;
+	int prefetch_mode;
+	// while the emulator keeps forks, writes go to a private overlay
+	// instead, seeded with the files in memory of the one used otherwise,
+	// so that every fork can keep its own copy of them
+	vfs_fork *forks;
+	int fork_size, fork_count;
+	int branching;
+	overlay_store *overlay_base;
+#endif
+
+	posix_vfs_stats stats;
+	posix_vfs_file_stats *file_stats;
+	u32 *file_stat_hashes;
+	int file_stat_count, file_stat_size;
+
+	vfs_context *next;
+};
+
+// all contexts, so that overlays can be saved on exit
+static vfs_context *vfs_contexts = NULL;
+#ifdef USE_PTHREADS
+static pthread_mutex_t vfs_contexts_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+// the one set up by init_posix_vfs(), used by threads which did not
+// pick one
+static vfs_context *vfs_default = NULL;
+static VFS_THREAD_LOCAL vfs_context *vfs_current = NULL;
+#ifdef USE_PTHREADS
+// shared by all contexts, and kept until exit once created
+static prefetch_cache *vfs_prefetch = NULL;
+#endif
+#ifdef USE_ZLIB
+static cas_store *vfs_cas = NULL;
+#endif
+
+static vfs_context *vfs_ctx(void) {
+	return vfs_current != NULL ? vfs_current : vfs_default;
+}
+
+#ifdef USE_PTHREADS
+// where the overlay saves files, or an empty string
+static const char *vfs_overlay_directory(vfs_context *ctx) {
+	overlay_store *overlay = ctx->branching ? ctx->overlay_base : ctx->overlay;
+	return overlay != NULL ? overlay_store_directory(overlay) : "";
+}
+#endif
+
+static u64 vfs_time_us(void) {
+#if defined(__unix__) || defined(__APPLE__)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	return (u64) clock() * 1000000 / CLOCKS_PER_SEC;
+#endif
+}
 
-static FILE* file_pointers[MAX_FILES];
-static char vfs_fnbuf[MAX_FNLEN+1];
-static char vfs_fndir[MAX_FNLEN+1];
-static int vfs_fnprefsize;
-static int vfs_initialized = 0;
+static void vfs_stat_record(vfs_context *ctx, int op, u64 start, int failed) {
+	u64 us = vfs_time_us() - start;
+	int bucket = 0;
+
+	while (bucket < POSIX_VFS_LATENCY_BUCKETS - 1 && (us >> bucket) != 0) bucket++;
+	ctx->stats.calls[op]++;
+	if (failed) ctx->stats.failures[op]++;
+	ctx->stats.total_us[op] += us;
+	if (us > ctx->stats.max_us[op]) ctx->stats.max_us[op] = us > 0xFFFFFFFF ? 0xFFFFFFFF : (u32) us;
+	ctx->stats.latency[op][bucket]++;
+}
+
+// few distinct files are opened, so a linear search does
+static int vfs_file_stat_find(vfs_context *ctx, const char *name) {
+	u32 hash = vfs_name_hash(name);
+	for (int i = 0; i < ctx->file_stat_count; i++) {
+		if (ctx->file_stat_hashes[i] == hash && strcasecmp(ctx->file_stats[i].name, name) == 0) return i;
+	}
+
+	if (ctx->file_stat_count >= ctx->file_stat_size) {
+		int size_new = ctx->file_stat_size > 0 ? ctx->file_stat_size * 2 : 16;
+		posix_vfs_file_stats *stats_new = realloc(ctx->file_stats, sizeof(posix_vfs_file_stats) * size_new);
+		if (stats_new == NULL) return -1;
+		ctx->file_stats = stats_new;
+		u32 *hashes_new = realloc(ctx->file_stat_hashes, sizeof(u32) * size_new);
+		if (hashes_new == NULL) return -1;
+		ctx->file_stat_hashes = hashes_new;
+		ctx->file_stat_size = size_new;
+	}
+	posix_vfs_file_stats *fs = &ctx->file_stats[ctx->file_stat_count];
+	memset(fs, 0, sizeof(posix_vfs_file_stats));
+	fs->name = strdup(name);
+	if (fs->name == NULL) return -1;
+	ctx->file_stat_hashes[ctx->file_stat_count] = hash;
+	return ctx->file_stat_count++;
+}
+
+static posix_vfs_file_stats *vfs_file_stat(vfs_context *ctx, vfs_handle *h) {
+	return h->stat_id >= 0 ? &ctx->file_stats[h->stat_id] : NULL;
+}
+
+static vfs_handle *vfs_get_handle(vfs_context *ctx, int handle) {
+	if (ctx == NULL || handle <= 0 || handle > ctx->handle_count || !ctx->handles[handle-1].used) return NULL;
+	return &ctx->handles[handle-1];
+}
+
+static void vfs_handles_init(vfs_context *ctx, int from) {
+	// pushed in reverse, so that lower slots are handed out first
+	for (int i = ctx->handle_count - 1; i >= from; i--) {
+		vfs_handle *h = &ctx->handles[i];
+		h->used = 0;
+		h->file = NULL;
+		h->map = NULL;
+		h->zip_id = -1;
+		h->cas_id = -1;
+		h->mem_id = -1;
+		h->overlay_id = -1;
+		h->stat_id = -1;
+		h->prefetch_id = -1;
+		h->next_free = ctx->free_first;
+		ctx->free_first = i;
+	}
+}
+
+static int vfs_handles_grow(vfs_context *ctx, int count) {
+	if (count <= ctx->handle_count) return 0;
+	if (count > VFS_MAX_HANDLES) return -1;
+
+	vfs_handle *handles_new = realloc(ctx->handles, sizeof(vfs_handle) * count);
+	if (handles_new == NULL) return -1;
+	ctx->handles = handles_new;
+	int from = ctx->handle_count;
+	ctx->handle_count = count;
+	vfs_handles_init(ctx, from);
+	return 0;
+}
+
+// after slots were taken out of order
+static void vfs_handles_rebuild_free(vfs_context *ctx) {
+	ctx->free_first = -1;
+	for (int i = ctx->handle_count - 1; i >= 0; i--) {
+		if (!ctx->handles[i].used) {
+			ctx->handles[i].next_free = ctx->free_first;
+			ctx->free_first = i;
+		}
+	}
+}
+
+static int vfs_handle_alloc(vfs_context *ctx) {
+	if (ctx->free_first < 0) {
+		int count = ctx->handle_count * 2;
+		if (count > VFS_MAX_HANDLES) count = VFS_MAX_HANDLES;
+		if (vfs_handles_grow(ctx, count) < 0 || ctx->free_first < 0) return -1;
+	}
+	int pos = ctx->free_first;
+	ctx->free_first = ctx->handles[pos].next_free;
+	return pos;
+}
+
+static void vfs_handle_free(vfs_context *ctx, int pos) {
+	ctx->handles[pos].used = 0;
+	ctx->handles[pos].next_free = ctx->free_first;
+	ctx->free_first = pos;
+}
 
 #if defined(NO_OPENDIR)
-static void vfs_fix_case(char *fn) { }
+static void vfs_fix_case(vfs_context *ctx, char *fn) { }
+static void vfs_index_invalidate(vfs_context *ctx) { }
+static void vfs_index_free(vfs_context *ctx) { }
 int vfs_findfirst(u8* ptr, u16 mask, char* spec) { return -1; }
 int vfs_findnext(u8* ptr) { return -1; }
 #else
-static void vfs_fix_case(char *fn) {
-	DIR *dir;
+
+#define VFS_INDEX_NAME(ctx, e) ((ctx)->index_names + (e)->name)
+
+static const char *vfs_index_ext(const char *name) {
+	const char *ext = strrchr(name, '.');
+	return ext != NULL ? ext : "";
+}
+
+static void vfs_index_free(vfs_context *ctx) {
+	free(ctx->index_entries);
+	free(ctx->index_names);
+	free(ctx->index_table);
+	ctx->index_entries = NULL;
+	ctx->index_names = NULL;
+	ctx->index_table = NULL;
+	ctx->index_count = 0;
+	ctx->index_size = 0;
+	ctx->index_names_len = 0;
+	ctx->index_names_size = 0;
+	ctx->index_table_size = 0;
+	ctx->index_valid = 0;
+#ifdef POSIX_VFS_INOTIFY
+	if (ctx->index_inotify >= 0) {
+		close(ctx->index_inotify);
+		ctx->index_inotify = -1;
+	}
+#endif
+}
+
+static void vfs_index_invalidate(vfs_context *ctx) {
+	ctx->index_valid = 0;
+}
+
+#if defined(POSIX_VFS_SORTED_DIRS)
+static VFS_THREAD_LOCAL const char *vfs_index_sort_names;
+
+static int vfs_index_strcmp(const void *a, const void *b) {
+	return strcasecmp(vfs_index_sort_names + ((const vfs_index_entry *)a)->name,
+		vfs_index_sort_names + ((const vfs_index_entry *)b)->name);
+}
+#endif
+
+static void vfs_index_build_table(vfs_context *ctx) {
+	// the table is kept at most half full, and only ever grows
+	int table_size = ctx->index_table_size > 0 ? ctx->index_table_size : 16;
+	while (table_size < ctx->index_count * 2) table_size *= 2;
+	if (table_size != ctx->index_table_size) {
+		free(ctx->index_table);
+		ctx->index_table = malloc(table_size * sizeof(int));
+		ctx->index_table_size = ctx->index_table != NULL ? table_size : 0;
+		if (ctx->index_table == NULL) return;
+	}
+	memset(ctx->index_table, 0, table_size * sizeof(int));
+	ctx->index_table_mask = table_size - 1;
+
+	for (int i = 0; i < ctx->index_count; i++) {
+		vfs_index_entry *e = &ctx->index_entries[i];
+		int pos = e->hash & ctx->index_table_mask;
+		while (ctx->index_table[pos] != 0) pos = (pos + 1) & ctx->index_table_mask;
+		ctx->index_table[pos] = i + 1;
+	}
+}
+
+static vfs_index_entry *vfs_index_lookup(vfs_context *ctx, const char *fn) {
+	if (ctx->index_table == NULL) return NULL;
+
+	u32 hash = vfs_name_hash(fn);
+	int pos = hash & ctx->index_table_mask;
+
+	while (ctx->index_table[pos] != 0) {
+		vfs_index_entry *e = &ctx->index_entries[ctx->index_table[pos] - 1];
+		if (e->hash == hash && strcasecmp(fn, VFS_INDEX_NAME(ctx, e)) == 0) return e;
+		pos = (pos + 1) & ctx->index_table_mask;
+	}
+	return NULL;
+}
+
+// names are copied into one arena; both it and the entry array are kept
+// between rebuilds, so that reading the directory again allocates nothing
+static vfs_index_entry *vfs_index_append(vfs_context *ctx, const char *name, int source) {
+	u32 len = strlen(name) + 1;
+
+	if (ctx->index_count >= ctx->index_size) {
+		int size_new = ctx->index_size > 0 ? ctx->index_size * 2 : 64;
+		vfs_index_entry *entries_new = realloc(ctx->index_entries, size_new * sizeof(vfs_index_entry));
+		if (entries_new == NULL) return NULL;
+		ctx->index_entries = entries_new;
+		ctx->index_size = size_new;
+	}
+	if (ctx->index_names_len + len > ctx->index_names_size) {
+		u32 size_new = ctx->index_names_size > 0 ? ctx->index_names_size : 1024;
+		while (ctx->index_names_len + len > size_new) size_new *= 2;
+		char *names_new = realloc(ctx->index_names, size_new);
+		if (names_new == NULL) return NULL;
+		ctx->index_names = names_new;
+		ctx->index_names_size = size_new;
+	}
+
+	vfs_index_entry *e = &ctx->index_entries[ctx->index_count++];
+	memcpy(ctx->index_names + ctx->index_names_len, name, len);
+	e->name = ctx->index_names_len;
+	ctx->index_names_len += len;
+	e->hash = vfs_name_hash(name);
+	e->source = source;
+	e->attr = 0;
+	e->stat_state = VFS_STAT_NONE;
+	return e;
+}
+
+// the file type, where the directory listing tells it for free
+static void vfs_index_set_type(vfs_index_entry *e, struct dirent *entry) {
+#ifdef DT_DIR
+	if (entry->d_type == DT_DIR) {
+		e->attr = VFS_ATTR_DIRECTORY;
+		e->stat_state = VFS_STAT_TYPE;
+	} else if (entry->d_type == DT_REG) {
+		e->attr = VFS_ATTR_ARCHIVE;
+		e->stat_state = VFS_STAT_TYPE;
+	}
+#endif
+}
+
+#ifdef USE_PTHREADS
+// entries of another directory; these shadow the ones already present
+static void vfs_index_merge_dir(vfs_context *ctx, const char *path) {
+	DIR *dir = opendir(path);
 	struct dirent *entry;
+	int count = ctx->index_count;
 
-	dir = opendir(vfs_fndir);
+	if (dir == NULL) return;
 	while ((entry = readdir(dir)) != NULL) {
-		if (strcasecmp(fn, entry->d_name) == 0) {
-			strncpy(fn, entry->d_name, strlen(fn));
+		vfs_index_entry *e = vfs_index_lookup(ctx, entry->d_name);
+		if (e != NULL) {
+			e->source = VFS_SOURCE_SAVED;
+			e->attr = 0;
+			e->stat_state = VFS_STAT_NONE;
+		} else if ((e = vfs_index_append(ctx, entry->d_name, VFS_SOURCE_SAVED)) == NULL) {
 			break;
 		}
+		vfs_index_set_type(e, entry);
 	}
-
 	closedir(dir);
+	if (ctx->index_count > count) vfs_index_build_table(ctx);
 }
+#endif
 
-static int vfs_find_filter(const struct dirent *entry, const char *spec) {
-	const char *name = entry->d_name;
-	int name_len = strlen(name);
-	if (name_len > 12) {
-		// skip too large names
-		return 0;
+// overlay and archive entries, then the extension buckets
+static void vfs_index_merge_rest(vfs_context *ctx) {
+	int ext_last[VFS_INDEX_EXT_BUCKETS];
+
+#ifdef USE_PTHREADS
+	// files in memory and saved files, which shadow everything else;
+	// the former are looked up again when listed, as they keep changing
+	if (ctx->overlay != NULL) {
+		int base_count = ctx->index_count;
+		for (int i = 0; i < overlay_file_count(ctx->overlay); i++) {
+			const char *name = overlay_file_name(ctx->overlay, i);
+			if (vfs_index_lookup(ctx, name) == NULL && vfs_index_append(ctx, name, VFS_SOURCE_OVERLAY) == NULL) break;
+		}
+		if (ctx->index_count > base_count) vfs_index_build_table(ctx);
+		const char *directory = vfs_overlay_directory(ctx);
+		if (directory[0] != 0 && (ctx->mem != NULL || strcmp(directory, ctx->fndir) != 0)) {
+			vfs_index_merge_dir(ctx, directory);
+		}
 	}
-	int spec_len = strlen(spec);
-	return strlen(name) >= spec_len && strcasecmp(name + strlen(name) - spec_len, spec) == 0;
-}
+#endif
+
+#ifdef USE_ZLIB
+	// archive entries in the top directory, unless shadowed on disk
+	if (ctx->zip != NULL && ctx->mem == NULL) {
+		int disk_count = ctx->index_count;
+		for (int i = 0; i < zip_entry_count(ctx->zip); i++) {
+			const char *name = zip_entry_name(ctx->zip, i);
+			if (strchr(name, '/') != NULL || vfs_index_lookup(ctx, name) != NULL) continue;
+			vfs_index_entry *e = vfs_index_append(ctx, name, VFS_SOURCE_ZIP);
+			if (e == NULL) break;
+			e->attr = VFS_ATTR_ARCHIVE | VFS_ATTR_READONLY;
+			e->size = zip_entry_size(ctx->zip, i);
+			e->dos_time = zip_entry_dos_time(ctx->zip, i);
+			e->stat_state = VFS_STAT_FULL;
+		}
+		if (ctx->index_count > disk_count) vfs_index_build_table(ctx);
+	}
+#endif
 
 #if defined(POSIX_VFS_SORTED_DIRS)
+	vfs_index_sort_names = ctx->index_names;
+	qsort(ctx->index_entries, ctx->index_count, sizeof(vfs_index_entry), vfs_index_strcmp);
+	vfs_index_build_table(ctx);
+#endif
+
+	for (int i = 0; i < VFS_INDEX_EXT_BUCKETS; i++) {
+		ctx->index_ext_first[i] = -1;
+		ext_last[i] = -1;
+	}
 
-static int vfs_dirent_size;
-static int vfs_dirent_count;
-static int vfs_dirent_pos;
-static char** vfs_dirents = NULL;
+	for (int i = 0; i < ctx->index_count; i++) {
+		vfs_index_entry *e = &ctx->index_entries[i];
+		e->ext_next = -1;
 
-static int vfs_find_strcmp(const void *a, const void *b) {
-	return strcasecmp(*((const char **)a), *((const char **)b));
+		// appended in order, so that buckets stay sorted
+		int bucket = vfs_name_hash(vfs_index_ext(VFS_INDEX_NAME(ctx, e))) & (VFS_INDEX_EXT_BUCKETS - 1);
+		if (ext_last[bucket] >= 0) ctx->index_entries[ext_last[bucket]].ext_next = i;
+		else ctx->index_ext_first[bucket] = i;
+		ext_last[bucket] = i;
+	}
+
+	ctx->index_valid = 1;
 }
 
-int vfs_findfirst(u8* ptr, u16 mask, char* spec) {
+static void vfs_index_build(vfs_context *ctx) {
 	DIR *dir;
 	struct dirent *entry;
-	int i;
-	char** vfs_dirents_new;
+	struct stat st;
 
-	if (strncmp(spec, "*.", 2) == 0) {
-		if (strlen(spec + 1) > MAX_SPECLEN) {
-			return -1;
+	ctx->index_count = 0;
+	ctx->index_names_len = 0;
+	ctx->index_generation++;
+
+	if (ctx->mem != NULL) {
+		for (int i = 0; i < mem_entry_count(ctx->mem); i++) {
+			const char *name = mem_entry_name(ctx->mem, i);
+			if (strchr(name, '/') != NULL) continue;
+			vfs_index_entry *e = vfs_index_append(ctx, name, VFS_SOURCE_MEM);
+			if (e == NULL) break;
+			int size;
+			mem_entry_data(ctx->mem, i, &size);
+			e->attr = VFS_ATTR_ARCHIVE;
+			e->size = size;
+			e->dos_time = mem_entry_dos_time(ctx->mem, i);
+			e->stat_state = VFS_STAT_FULL;
 		}
-		if (vfs_dirent_size == 0) {
-			// initial allocation
-			vfs_dirent_size = 64;
-			vfs_dirents = malloc(vfs_dirent_size * sizeof(char*));
-		} else {
-			// freeing
-			for (i = 0; i < vfs_dirent_size; i++) {
-				if (vfs_dirents[i] != NULL) {
-					free(vfs_dirents[i]);
-					vfs_dirents[i] = NULL;
-				}
-			}
+		vfs_index_build_table(ctx);
+		vfs_index_merge_rest(ctx);
+		return;
+	}
+
+#ifdef POSIX_VFS_INOTIFY
+	// the watch is per process, as forked children would consume
+	// each other's events
+	if (ctx->index_inotify >= 0 && ctx->index_inotify_pid != getpid()) {
+		close(ctx->index_inotify);
+		ctx->index_inotify = -1;
+	}
+	if (ctx->index_inotify < 0) {
+		// files written or changed count too, as their stat snapshots
+		// would go stale
+		ctx->index_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (ctx->index_inotify >= 0 && inotify_add_watch(ctx->index_inotify, ctx->fndir,
+			IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF
+			| IN_CLOSE_WRITE | IN_ATTRIB) < 0)
+		{
+			close(ctx->index_inotify);
+			ctx->index_inotify = -1;
 		}
-		vfs_dirent_count = 0;
-		dir = opendir(vfs_fndir);
+		ctx->index_inotify_pid = getpid();
+	}
+#endif
+	// taken before reading, so that changes made meanwhile are noticed
+	ctx->index_time = time(NULL);
+	ctx->index_mtime = stat(ctx->fndir, &st) == 0 ? st.st_mtime : 0;
+
+	dir = opendir(ctx->fndir);
+	if (dir != NULL) {
 		while ((entry = readdir(dir)) != NULL) {
-			if (vfs_find_filter(entry, spec + 1) != 0) {
-				vfs_dirents[vfs_dirent_count++] = strdup(entry->d_name);
-				if (vfs_dirent_count >= vfs_dirent_size) {
-					vfs_dirent_size *= 2;
-					vfs_dirents_new = realloc(vfs_dirents, vfs_dirent_size * sizeof(char*));
-					if (vfs_dirents_new != NULL) {
-						vfs_dirents = vfs_dirents_new;
-					} else {
-						goto FindFirstDirentEarlyExit;
-					}
-				}
-			}
+			vfs_index_entry *e = vfs_index_append(ctx, entry->d_name, VFS_SOURCE_DISK);
+			if (e == NULL) break;
+			vfs_index_set_type(e, entry);
 		}
-FindFirstDirentEarlyExit:
 		closedir(dir);
-		vfs_dirent_pos = 0;
+	}
+	vfs_index_build_table(ctx);
+
+	vfs_index_merge_rest(ctx);
+}
 
-		qsort(vfs_dirents, vfs_dirent_count, sizeof(char*), vfs_find_strcmp);
+static void vfs_index_update(vfs_context *ctx) {
+	if (ctx->index_valid) {
+		// bundles do not change
+		if (ctx->mem != NULL) return;
+#ifdef POSIX_VFS_INOTIFY
+		if (ctx->index_inotify >= 0 && ctx->index_inotify_pid == getpid()) {
+			char events[4096];
+			int changed = 0;
+			while (read(ctx->index_inotify, events, sizeof(events)) > 0) changed = 1;
+			if (!changed) return;
+		} else
+#endif
+		{
+			struct stat st;
+			// a change within the second the index was read in
+			// would not move the modification time, so keep checking
+			if (stat(ctx->fndir, &st) == 0 && st.st_mtime == ctx->index_mtime && st.st_mtime < ctx->index_time) return;
+		}
+	}
+	vfs_index_build(ctx);
+}
 
-		return vfs_findnext(ptr);
-	} else {
-		return -1;
+static void vfs_fix_case(vfs_context *ctx, char *fn) {
+	vfs_index_update(ctx);
+	vfs_index_entry *e = vfs_index_lookup(ctx, fn);
+	if (e != NULL) {
+		strncpy(fn, VFS_INDEX_NAME(ctx, e), strlen(fn));
 	}
 }
 
-int vfs_findnext(u8* ptr) {
-	if (vfs_dirent_pos < vfs_dirent_count) {
-		memset(ptr + 0x15, 0, 0x1E - 0x15);
-		strcpy((char*) (ptr + 0x1E), vfs_dirents[vfs_dirent_pos++]);
+// fills in the rest of the entry's stat snapshot: only the type when
+// filtering by attributes, everything once it is listed
+static void vfs_index_stat(vfs_context *ctx, vfs_index_entry *e, int state) {
+	char path[MAX_FNLEN * 2 + 2];
+	struct stat st;
+
+	if (e->stat_state >= state || e->source == VFS_SOURCE_OVERLAY) return;
+	const char *dir = ctx->fndir;
+#ifdef USE_PTHREADS
+	if (e->source == VFS_SOURCE_SAVED) dir = vfs_overlay_directory(ctx);
+#endif
+	snprintf(path, sizeof(path), "%s/%s", dir, VFS_INDEX_NAME(ctx, e));
+	e->stat_state = VFS_STAT_FULL;
+	if (stat(path, &st) != 0) {
+		// gone since; listed as an empty file
+		e->attr = VFS_ATTR_ARCHIVE;
+		e->size = 0;
+		e->dos_time = vfs_dos_time(ctx->index_time);
+		return;
+	}
+	e->attr = S_ISDIR(st.st_mode) ? VFS_ATTR_DIRECTORY : VFS_ATTR_ARCHIVE;
+	if (!(st.st_mode & S_IWUSR)) e->attr |= VFS_ATTR_READONLY;
+	e->size = (S_ISDIR(st.st_mode) || st.st_size < 0) ? 0 : (st.st_size > 0xFFFFFFFFL ? 0xFFFFFFFF : (u32) st.st_size);
+	e->dos_time = vfs_dos_time(st.st_mtime);
+}
+
+// DOS wildcards work on the blank-padded 8.3 form of a name: '?' matches
+// any character, padding included, and '*' fills the rest of its part
+// with '?'. As with DOS, "*" alone only matches names without extension
+static const char *vfs_find_pattern_part(u8 *out, int len, const char *spec) {
+	int i = 0;
+	for (; *spec != 0 && *spec != '.'; spec++) {
+		if (*spec == '*') {
+			while (i < len) out[i++] = '?';
+		} else if (i < len) {
+			u8 c = (u8) *spec;
+			out[i++] = (c >= 'a' && c <= 'z') ? (c - 32) : c;
+		}
+	}
+	while (i < len) out[i++] = ' ';
+	return spec;
+}
+
+static int vfs_find_pattern(u8 *pattern, const char *spec) {
+	// the drive is ignored; other directories are not indexed
+	if (spec[0] != 0 && spec[1] == ':') spec += 2;
+	if (strchr(spec, '\\') != NULL || strchr(spec, '/') != NULL) return -1;
+	if (spec[0] == 0) return -1;
+
+	spec = vfs_find_pattern_part(pattern, 8, spec);
+	if (*spec == '.') spec++;
+	spec = vfs_find_pattern_part(pattern + 8, 3, spec);
+	return *spec == 0 ? 0 : -1;
+}
+
+// names which do not fit 8.3 are not listed
+static int vfs_find_short_name(u8 *out, const char *name) {
+	const char *dot = strchr(name, '.');
+	int base_len, ext_len;
+
+	memset(out, ' ', 11);
+	if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+		memcpy(out, name, strlen(name));
 		return 0;
-	} else {
+	}
+	base_len = dot != NULL ? (dot - name) : (int) strlen(name);
+	ext_len = dot != NULL ? (int) strlen(dot + 1) : 0;
+	if (base_len < 1 || base_len > 8 || ext_len > 3 || strchr(name, ' ') != NULL) return -1;
+	if (dot != NULL && strchr(dot + 1, '.') != NULL) return -1;
+
+	for (int i = 0; i < base_len; i++) {
+		u8 c = (u8) name[i];
+		out[i] = (c >= 'a' && c <= 'z') ? (c - 32) : c;
+	}
+	for (int i = 0; i < ext_len; i++) {
+		u8 c = (u8) dot[1 + i];
+		out[8 + i] = (c >= 'a' && c <= 'z') ? (c - 32) : c;
+	}
+	return 0;
+}
+
+static int vfs_find_match(vfs_context *ctx, vfs_index_entry *e) {
+	u8 short_name[11];
+
+	if (vfs_find_short_name(short_name, VFS_INDEX_NAME(ctx, e)) < 0) return 0;
+	for (int i = 0; i < 11; i++) {
+		if (ctx->find_pattern[i] != '?' && ctx->find_pattern[i] != short_name[i]) return 0;
+	}
+
+	// entries which are hidden, system files or directories are only
+	// listed when asked for
+	vfs_index_stat(ctx, e, VFS_STAT_TYPE);
+	return (e->attr & (VFS_ATTR_HIDDEN | VFS_ATTR_SYSTEM | VFS_ATTR_DIRECTORY) & ~ctx->find_mask) == 0;
+}
+
+static void vfs_find_fill(vfs_context *ctx, vfs_index_entry *e, u8 *ptr) {
+	u32 size, dos_time;
+	u8 attr;
+
+	vfs_index_stat(ctx, e, VFS_STAT_FULL);
+	attr = e->attr;
+	size = e->size;
+	dos_time = e->dos_time;
+#ifdef USE_PTHREADS
+	// files in memory shadow the entry, and have no time of their own
+	if (ctx->overlay != NULL) {
+		int id = overlay_file_find(ctx->overlay, VFS_INDEX_NAME(ctx, e));
+		if (id >= 0) {
+			attr = VFS_ATTR_ARCHIVE;
+			size = overlay_file_size(ctx->overlay, id);
+			if (e->source == VFS_SOURCE_OVERLAY) dos_time = vfs_dos_time(time(NULL));
+		}
+	}
+#endif
+
+	// the reserved part holds the search, as DOS keeps it
+	ptr[0x00] = 3;
+	memcpy(ptr + 0x01, ctx->find_pattern, 11);
+	ptr[0x0C] = ctx->find_mask;
+	memset(ptr + 0x0D, 0, 0x15 - 0x0D);
+	ptr[0x15] = attr;
+	ptr[0x16] = dos_time & 0xFF;
+	ptr[0x17] = (dos_time >> 8) & 0xFF;
+	ptr[0x18] = (dos_time >> 16) & 0xFF;
+	ptr[0x19] = (dos_time >> 24) & 0xFF;
+	ptr[0x1A] = size & 0xFF;
+	ptr[0x1B] = (size >> 8) & 0xFF;
+	ptr[0x1C] = (size >> 16) & 0xFF;
+	ptr[0x1D] = (size >> 24) & 0xFF;
+	strcpy((char*) (ptr + 0x1E), VFS_INDEX_NAME(ctx, e));
+}
+
+static int vfs_find_next(vfs_context *ctx, u8* ptr);
+
+static int vfs_find_first(vfs_context *ctx, u8* ptr, u16 mask, char* spec) {
+	char ext[5];
+
+	ctx->find_pos = -1;
+	if (vfs_find_pattern(ctx->find_pattern, spec) < 0) {
+		return -1;
+	}
+	ctx->find_mask = mask & 0xFF;
+	// a search for the volume label alone; there is none
+	if (ctx->find_mask == VFS_ATTR_VOLUME) {
 		return -1;
 	}
+
+	vfs_index_update(ctx);
+	ctx->find_generation = ctx->index_generation;
+	// an extension without wildcards only needs its bucket, such
+	// as with "*.ZZT"
+	ctx->find_bucketed = ctx->find_pattern[8] != ' ' && memchr(ctx->find_pattern + 8, '?', 3) == NULL;
+	if (ctx->find_bucketed) {
+		int len = 0;
+		ext[len++] = '.';
+		while (len < 4 && ctx->find_pattern[7 + len] != ' ') {
+			ext[len] = ctx->find_pattern[7 + len];
+			len++;
+		}
+		ext[len] = 0;
+		ctx->find_pos = ctx->index_ext_first[vfs_name_hash(ext) & (VFS_INDEX_EXT_BUCKETS - 1)];
+	} else {
+		ctx->find_pos = 0;
+	}
+	return vfs_find_next(ctx, ptr);
 }
 
-#else
+static int vfs_find_next(vfs_context *ctx, u8* ptr) {
+	// a listing does not survive the index being read again
+	if (ctx->find_generation != ctx->index_generation) {
+		ctx->find_pos = -1;
+	}
 
-// on-demand implementation
+	while (ctx->find_pos >= 0 && ctx->find_pos < ctx->index_count) {
+		vfs_index_entry *e = &ctx->index_entries[ctx->find_pos];
+		ctx->find_pos = ctx->find_bucketed ? e->ext_next : (ctx->find_pos + 1);
+		if (vfs_find_match(ctx, e)) {
+			vfs_find_fill(ctx, e, ptr);
+			return 0;
+		}
+	}
 
-static DIR *vfs_finddir;
-static char vfs_findspec[MAX_SPECLEN+1];
+	ctx->find_pos = -1;
+	return -1;
+}
 
 int vfs_findfirst(u8* ptr, u16 mask, char* spec) {
-	vfs_findspec[0] = 0; // clear findspec
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL) return -1;
 
-	if (strncmp(spec, "*.", 2) == 0) {
-		if (strlen(spec+1) > MAX_SPECLEN) {
-			return -1;
+	u64 start = vfs_time_us();
+	int result = vfs_find_first(ctx, ptr, mask, spec);
+	vfs_stat_record(ctx, POSIX_VFS_STAT_FINDFIRST, start, result < 0);
+	return result;
+}
+
+int vfs_findnext(u8* ptr) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL) return -1;
+
+	u64 start = vfs_time_us();
+	int result = vfs_find_next(ctx, ptr);
+	vfs_stat_record(ctx, POSIX_VFS_STAT_FINDNEXT, start, result < 0);
+	return result;
+}
+#endif /* !NO_OPENDIR */
+
+static int vfs_release(vfs_context *ctx, int pos) {
+	vfs_handle *h = &ctx->handles[pos];
+	FILE* fptr = h->file;
+	h->file = NULL;
+	h->used = 0;
+	if (h->overlay_id >= 0 || h->mem_id >= 0) {
+		h->overlay_id = -1;
+		h->mem_id = -1;
+		h->map = NULL;
+		return 0;
+	}
+#ifdef USE_ZLIB
+	if (h->cas_id >= 0) {
+		cas_object_release(vfs_cas, h->cas_id);
+		h->cas_id = -1;
+		h->map = NULL;
+		return 0;
+	}
+	if (h->zip_id >= 0) {
+		zip_entry_release(ctx->zip, h->zip_id);
+		h->zip_id = -1;
+		h->map = NULL;
+		return 0;
+	}
+#endif
+#ifdef USE_PTHREADS
+	if (h->prefetch_id >= 0) {
+		prefetch_file_release(vfs_prefetch, h->prefetch_id);
+		h->prefetch_id = -1;
+		h->map = NULL;
+	}
+#endif
+#ifdef POSIX_VFS_READ_COPY
+	if (h->map != NULL) {
+		free(h->map);
+		h->map = NULL;
+	}
+#endif
+	// the listed size and time of the file changed
+	if ((h->mode & 0x10003) != 0) vfs_index_invalidate(ctx);
+	return fclose(fptr);
+}
+
+static void vfs_release_all(vfs_context *ctx) {
+	for (int i = 0; i < ctx->handle_count; i++) {
+		if (ctx->handles[i].used) {
+			vfs_release(ctx, i);
 		}
-		strncpy(vfs_findspec, spec + 1, MAX_SPECLEN); // skip the *
-		vfs_finddir = opendir(vfs_fndir);
-		return vfs_findnext(ptr);
+	}
+	vfs_handles_rebuild_free(ctx);
+}
+
+static void vfs_set_path(vfs_context *ctx, const char *path) {
+	strncpy(ctx->fnbuf, path, MAX_FNLEN);
+	ctx->fnprefsize = strlen(ctx->fnbuf);
+	if (strlen(path) == 0) {
+		strcpy(ctx->fndir, ".");
 	} else {
-		return -1;
+		strncpy(ctx->fndir, path, MAX_FNLEN);
 	}
 }
 
-int vfs_findnext(u8* ptr) {
-	struct dirent *entry;
-	if (vfs_finddir == NULL) {
+vfs_context *posix_vfs_context_create(const char* path) {
+	vfs_context *ctx = calloc(1, sizeof(vfs_context));
+	if (ctx == NULL) return NULL;
+
+	ctx->free_first = -1;
+	if (vfs_handles_grow(ctx, MAX_FILES) < 0) {
+		free(ctx);
+		return NULL;
+	}
+#ifdef POSIX_VFS_INOTIFY
+	ctx->index_inotify = -1;
+#endif
+	ctx->find_pos = -1;
+	vfs_set_path(ctx, path);
+
+#ifdef USE_PTHREADS
+	pthread_mutex_lock(&vfs_contexts_lock);
+#endif
+	ctx->next = vfs_contexts;
+	vfs_contexts = ctx;
+#ifdef USE_PTHREADS
+	pthread_mutex_unlock(&vfs_contexts_lock);
+#endif
+	return ctx;
+}
+
+void posix_vfs_context_free(vfs_context* ctx) {
+	vfs_release_all(ctx);
+	vfs_index_free(ctx);
+	if (ctx->mem != NULL) mem_bundle_close(ctx->mem);
+#ifdef USE_ZLIB
+	if (ctx->zip != NULL) zip_archive_close(ctx->zip);
+#endif
+
+#ifdef USE_PTHREADS
+	pthread_mutex_lock(&vfs_contexts_lock);
+#endif
+	vfs_context **prev = &vfs_contexts;
+	while (*prev != ctx) prev = &(*prev)->next;
+	*prev = ctx->next;
+#ifdef USE_PTHREADS
+	// closed with the list locked, so that it is not closed twice
+	if (ctx->overlay != NULL) overlay_store_close(ctx->overlay);
+	if (ctx->overlay_base != NULL) overlay_store_close(ctx->overlay_base);
+	pthread_mutex_unlock(&vfs_contexts_lock);
+	for (int i = 0; i < ctx->fork_size; i++) {
+		if (ctx->forks[i].overlay != NULL) overlay_store_close(ctx->forks[i].overlay);
+		free(ctx->forks[i].handles);
+	}
+	free(ctx->forks);
+#endif
+
+	for (int i = 0; i < ctx->file_stat_count; i++) {
+		free((char*) ctx->file_stats[i].name);
+	}
+	free(ctx->file_stats);
+	free(ctx->file_stat_hashes);
+	if (vfs_default == ctx) vfs_default = NULL;
+	if (vfs_current == ctx) vfs_current = NULL;
+	free(ctx->handles);
+	free(ctx);
+}
+
+void posix_vfs_context_set_current(vfs_context* ctx) {
+	vfs_current = ctx;
+}
+
+vfs_context *posix_vfs_context_get_current(void) {
+	return vfs_ctx();
+}
+
+void init_posix_vfs(const char* path) {
+	vfs_context *ctx = vfs_ctx();
+
+	if (ctx == NULL) {
+		vfs_default = posix_vfs_context_create(path);
+		return;
+	}
+
+	vfs_index_free(ctx);
+	vfs_release_all(ctx);
+	vfs_set_path(ctx, path);
+}
+
+#ifdef USE_ZLIB
+static int vfs_zip_copy_up(vfs_context *ctx, int id, const char *path) {
+	int size;
+	const u8 *data = zip_entry_acquire(ctx->zip, id, &size);
+	if (data == NULL) return -1;
+
+	FILE *file = fopen(path, "wb");
+	int result = -1;
+	if (file != NULL) {
+		result = (size == 0 || fwrite(data, size, 1, file) == 1) ? 0 : -1;
+		if (fclose(file) != 0) result = -1;
+	}
+	zip_entry_release(ctx->zip, id);
+	vfs_index_invalidate(ctx);
+	return result;
+}
+
+// archive entries are unpacked into the store once per host, and mapped
+// from there by every instance
+static const u8 *vfs_cas_acquire(vfs_context *ctx, int id, int *size, int *cas_id) {
+	if (vfs_cas == NULL) return NULL;
+
+	// keyed by how the member is stored, which no other archive can
+	// claim without storing the same contents
+	u8 key[CAS_KEY_SIZE];
+	u32 crc = zip_entry_crc(ctx->zip, id);
+	*size = zip_entry_size(ctx->zip, id);
+	if (*size <= 0 || zip_entry_digest(ctx->zip, id, key) < 0) return NULL;
+	const u8 *data = cas_object_acquire(vfs_cas, key, crc, *size, cas_id);
+	if (data != NULL) return data;
+
+	// unpacked past the archive's cache, as only the stored copy is kept
+	u8 *unpacked = malloc(*size);
+	if (unpacked == NULL) return NULL;
+	if (zip_entry_unpack(ctx->zip, id, unpacked) >= 0) {
+		data = cas_object_store(vfs_cas, key, unpacked, *size, crc, cas_id);
+	}
+	free(unpacked);
+	return data;
+}
+
+int posix_vfs_set_cache(const char *directory) {
+	if (vfs_cas != NULL) return -1;
+	vfs_cas = cas_store_open(directory);
+	return vfs_cas != NULL ? 0 : -1;
+}
+
+int posix_vfs_mount_zip(const char *filename) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL) return -1;
+	for (int i = 0; i < ctx->handle_count; i++) {
+		if (ctx->handles[i].used && ctx->handles[i].zip_id >= 0) return -1;
+	}
+
+	zip_archive *zip = NULL;
+	if (filename != NULL) {
+		zip = zip_archive_open(filename);
+		if (zip == NULL) return -1;
+	}
+	if (ctx->zip != NULL) zip_archive_close(ctx->zip);
+	ctx->zip = zip;
+	vfs_index_invalidate(ctx);
+	return 0;
+}
+#else
+int posix_vfs_set_cache(const char *directory) {
+	return -1;
+}
+
+int posix_vfs_mount_zip(const char *filename) {
+	return -1;
+}
+#endif
+
+#ifdef USE_PTHREADS
+static u8 *vfs_read_file(const char *path, int *len) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return NULL;
+
+	u8 *data = NULL;
+	long size = (fseek(file, 0, SEEK_END) == 0) ? ftell(file) : -1;
+	if (size >= 0 && size < 0x7FFFFFFF && fseek(file, 0, SEEK_SET) == 0) {
+		data = malloc(size > 0 ? size : 1);
+		if (data != NULL && size > 0 && fread(data, size, 1, file) != 1) {
+			free(data);
+			data = NULL;
+		}
+		*len = size;
+	}
+	fclose(file);
+	return data;
+}
+
+// returns an overlay file ID, or -1 if the file is to be opened as usual
+static int vfs_overlay_open(vfs_context *ctx, const char *name, int mode) {
+	char path[MAX_FNLEN * 2 + 2];
+	const char *directory = vfs_overlay_directory(ctx);
+	int id = overlay_file_find(ctx->overlay, name);
+	u8 *data = NULL;
+	int len = 0;
+
+	if (id >= 0) {
+		if (mode & 0x10000) overlay_file_truncate(ctx->overlay, id);
+		return id;
+	}
+
+	// a file saved by an earlier run; only consulted when it is not
+	// the same directory the rest of the files are read from
+	if (directory[0] != 0 && (ctx->mem != NULL || strcmp(directory, ctx->fndir) != 0) && !(mode & 0x10000)) {
+		snprintf(path, sizeof(path), "%s/%s", directory, name);
+		data = vfs_read_file(path, &len);
+	}
+	if (data == NULL && (mode & 0x10003) == 0) {
 		return -1;
 	}
 
-	while ((entry = readdir(vfs_finddir)) != NULL) {
-		if (vfs_find_filter(entry, vfs_findspec) != 0) {
-			memset(ptr + 0x15, 0, 0x1E - 0x15);
-			strcpy((char*) (ptr + 0x1E), entry->d_name);
-			return 0;
+	// copy on write
+	if (data == NULL && !(mode & 0x10000) && ctx->mem != NULL) {
+		int mem_id = mem_entry_find(ctx->mem, name);
+		if (mem_id < 0) return -2;
+		const u8 *mem_data = mem_entry_data(ctx->mem, mem_id, &len);
+		id = overlay_file_create(ctx->overlay, name, mem_data, len);
+		return id >= 0 ? id : -2;
+	}
+	if (data == NULL && !(mode & 0x10000)) {
+		data = vfs_read_file(ctx->fnbuf, &len);
+#ifdef USE_ZLIB
+		int zip_id;
+		if (data == NULL && ctx->zip != NULL && (zip_id = zip_entry_find(ctx->zip, name)) >= 0) {
+			const u8 *zip_data = zip_entry_acquire(ctx->zip, zip_id, &len);
+			if (zip_data == NULL) return -2;
+			id = overlay_file_create(ctx->overlay, name, zip_data, len);
+			zip_entry_release(ctx->zip, zip_id);
+			return id >= 0 ? id : -2;
 		}
+#endif
+		if (data == NULL) return -2;
 	}
 
-	closedir(vfs_finddir);
-	vfs_finddir = NULL;
+	id = overlay_file_create(ctx->overlay, name, data, len);
+	free(data);
+	if (id < 0) return -2;
+	if (mode & 0x10000) {
+		// the file is new, or replaces one
+		overlay_file_truncate(ctx->overlay, id);
+		vfs_index_invalidate(ctx);
+	}
+	return id;
+}
+
+static int vfs_overlay_in_use(vfs_context *ctx) {
+	for (int i = 0; i < ctx->handle_count; i++) {
+		if (ctx->handles[i].used && ctx->handles[i].overlay_id >= 0) return 1;
+	}
+	return 0;
+}
+
+// pending changes are saved on exit, open files or not; the stores are
+// left in place, as other threads may still be writing to them
+static void vfs_overlay_exit(void) {
+	pthread_mutex_lock(&vfs_contexts_lock);
+	for (vfs_context *ctx = vfs_contexts; ctx != NULL; ctx = ctx->next) {
+		if (ctx->overlay != NULL) overlay_store_flush(ctx->overlay);
+		if (ctx->overlay_base != NULL) overlay_store_flush(ctx->overlay_base);
+	}
+	pthread_mutex_unlock(&vfs_contexts_lock);
+}
+
+static void vfs_overlay_register_exit(void) {
+	atexit(vfs_overlay_exit);
+}
+
+int posix_vfs_set_overlay(const char *directory, int sync_mode) {
+	static pthread_once_t exit_once = PTHREAD_ONCE_INIT;
+	vfs_context *ctx = vfs_ctx();
+
+	if (ctx == NULL || ctx->branching || vfs_overlay_in_use(ctx)) return -1;
+
+	overlay_store *overlay = NULL;
+	if (directory != NULL) {
+		if (strlen(directory) > MAX_FNLEN) return -1;
+		overlay = overlay_store_open(directory, OVERLAY_FLUSH_DEFAULT_MS, sync_mode);
+		if (overlay == NULL) return -1;
+		pthread_once(&exit_once, vfs_overlay_register_exit);
+	}
+	if (ctx->overlay != NULL) overlay_store_close(ctx->overlay);
+	ctx->overlay = overlay;
+	ctx->overlay_private = 0;
+	if (ctx->overlay == NULL && ctx->mem != NULL) {
+		ctx->overlay = overlay_store_open(NULL, 0, OVERLAY_SYNC_NONE);
+		ctx->overlay_private = 1;
+	}
+	vfs_index_invalidate(ctx);
+	return 0;
+}
+
+void posix_vfs_flush(void) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL) return;
+	if (ctx->overlay != NULL) overlay_store_flush(ctx->overlay);
+	if (ctx->overlay_base != NULL) overlay_store_flush(ctx->overlay_base);
+}
+#else
+int posix_vfs_set_overlay(const char *directory, int sync_mode) {
 	return -1;
 }
+
+void posix_vfs_flush(void) {
+}
 #endif
-#endif /* !NO_OPENDIR */
 
-void init_posix_vfs(const char* path) {
-	if (vfs_initialized > 0) {
-		for (int i = 0; i < MAX_FILES; i++) {
-			if (file_pointers[i] != NULL) {
-				fclose(file_pointers[i]);
-				file_pointers[i] = NULL;
-			}
+int posix_vfs_mount_memory(const char *path) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL) return -1;
+	for (int i = 0; i < ctx->handle_count; i++) {
+		if (ctx->handles[i].used && ctx->handles[i].mem_id >= 0) return -1;
+	}
+#ifdef USE_PTHREADS
+	if (ctx->branching || (ctx->overlay_private && vfs_overlay_in_use(ctx))) return -1;
+#endif
+
+	mem_bundle *bundle = NULL;
+	if (path != NULL) {
+		bundle = mem_bundle_open(path);
+		if (bundle == NULL) return -1;
+	}
+	if (ctx->mem != NULL) mem_bundle_close(ctx->mem);
+	ctx->mem = bundle;
+
+#ifdef USE_PTHREADS
+	// changes are private to this VFS, and dropped on unmount
+	if (ctx->mem != NULL && ctx->overlay == NULL) {
+		ctx->overlay = overlay_store_open(NULL, 0, OVERLAY_SYNC_NONE);
+		ctx->overlay_private = 1;
+	} else if (ctx->mem == NULL && ctx->overlay_private) {
+		overlay_store_close(ctx->overlay);
+		ctx->overlay = NULL;
+		ctx->overlay_private = 0;
+	}
+#endif
+	vfs_index_invalidate(ctx);
+	return 0;
+}
+
+static void vfs_pick_world(const char *entry, const char **best) {
+	int len = strlen(entry);
+	if (len < 5 || len > 12 || strchr(entry, '/') != NULL || strchr(entry, '\\') != NULL) return;
+	if (strcasecmp(entry + len - 4, ".ZZT") != 0) return;
+	if (*best == NULL || strcasecmp(entry, *best) < 0) *best = entry;
+}
+
+int posix_vfs_find_mounted_world(char *name, int len) {
+	vfs_context *ctx = vfs_ctx();
+	const char *best = NULL;
+	if (ctx == NULL || len <= 0) return -1;
+
+	if (ctx->mem != NULL) {
+		for (int i = 0; i < mem_entry_count(ctx->mem); i++) {
+			vfs_pick_world(mem_entry_name(ctx->mem, i), &best);
+		}
+	}
+#ifdef USE_ZLIB
+	if (best == NULL && ctx->zip != NULL) {
+		for (int i = 0; i < zip_entry_count(ctx->zip); i++) {
+			vfs_pick_world(zip_entry_name(ctx->zip, i), &best);
 		}
 	}
+#endif
+	if (best == NULL) return -1;
+	strncpy(name, best, len - 1);
+	name[len - 1] = 0;
+	return 0;
+}
+
+#ifdef USE_PTHREADS
+static void vfs_handle_path(vfs_context *ctx, vfs_handle *h, char *path) {
+	snprintf(path, MAX_FNLEN + 1, "%.*s%s", ctx->fnprefsize, ctx->fnbuf, h->name);
+}
+
+// switches the handle over to the read-ahead copy of its file, if there
+// is one; returns 1 if so, 0 if one is on the way, -1 otherwise
+static int vfs_prefetch_take(vfs_context *ctx, vfs_handle *h) {
+	char path[MAX_FNLEN + 1];
+	int len, id;
+
+	if (vfs_prefetch == NULL || ctx->prefetch_mode == POSIX_VFS_PREFETCH_OFF) return -1;
+	vfs_handle_path(ctx, h, path);
+	const u8 *data = prefetch_file_acquire(vfs_prefetch, path, h->file_size, h->file_mtime, &len, &id);
+	if (data == NULL) return id;
+
+	long pos = h->map != NULL ? h->pos : ftell(h->file);
+#ifdef POSIX_VFS_READ_COPY
+	free(h->map);
+#endif
+	h->map = (u8*) data;
+	h->map_size = len;
+	h->pos = pos;
+	h->prefetch_id = id;
+	h->prefetch_pending = 0;
+	return 1;
+}
 
-	strncpy(vfs_fnbuf, path, MAX_FNLEN);
-	vfs_fnprefsize = strlen(vfs_fnbuf);
-	for (int i = 0; i < MAX_FILES; i++) {
-		file_pointers[i] = NULL;
+// files read from start to end, such as worlds being loaded, are read
+// ahead in the background once noticed, and served from memory after
+static void vfs_prefetch_track(vfs_context *ctx, vfs_handle *h, int amount) {
+	if (h->prefetch_pending) {
+		if (vfs_prefetch_take(ctx, h) < 0) h->prefetch_pending = 0;
+		return;
 	}
 
-	if (strlen(path) == 0) {
-		strcpy(vfs_fndir, ".");
-	} else {
-		strncpy(vfs_fndir, path, MAX_FNLEN);
+	long pos = h->map != NULL ? h->pos : ftell(h->file);
+	h->seq_reads = (pos == h->read_end) ? (h->seq_reads + 1) : 0;
+	h->read_end = pos + amount;
+	if (h->seq_reads == VFS_PREFETCH_SEQ_READS && h->read_end < h->file_size) {
+		char path[MAX_FNLEN + 1];
+		vfs_handle_path(ctx, h, path);
+		prefetch_file_request(vfs_prefetch, path);
+		h->prefetch_pending = vfs_prefetch_take(ctx, h) == 0;
 	}
-	vfs_initialized = 1;
 }
 
-int vfs_open(const char* filename, int mode) {
+static int vfs_prefetch_is_world(const char *name) {
+	const char *ext = strrchr(name, '.');
+	return ext != NULL && (strcasecmp(ext, ".ZZT") == 0 || strcasecmp(ext, ".BRD") == 0 || strcasecmp(ext, ".SAV") == 0);
+}
+
+int posix_vfs_set_prefetch(int mode) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL) return -1;
+
+	if (mode != POSIX_VFS_PREFETCH_OFF) {
+		pthread_mutex_lock(&vfs_contexts_lock);
+		if (vfs_prefetch == NULL) vfs_prefetch = prefetch_cache_open(PREFETCH_DEFAULT_LIMIT);
+		pthread_mutex_unlock(&vfs_contexts_lock);
+		if (vfs_prefetch == NULL) return -1;
+	}
+	ctx->prefetch_mode = mode;
+
+#ifndef NO_OPENDIR
+	if (mode == POSIX_VFS_PREFETCH_WORLDS && ctx->mem == NULL) {
+		char path[MAX_FNLEN + 1];
+		vfs_index_update(ctx);
+		for (int i = 0; i < ctx->index_count; i++) {
+			vfs_index_entry *e = &ctx->index_entries[i];
+			const char *name = VFS_INDEX_NAME(ctx, e);
+			if (e->source != VFS_SOURCE_DISK || !vfs_prefetch_is_world(name)) continue;
+			if (ctx->fnprefsize + strlen(name) > MAX_FNLEN) continue;
+			snprintf(path, sizeof(path), "%.*s%s", ctx->fnprefsize, ctx->fnbuf, name);
+			prefetch_file_request(vfs_prefetch, path);
+		}
+	}
+#endif
+	return 0;
+}
+#else
+int posix_vfs_set_prefetch(int mode) {
+	return mode == 0 ? 0 : -1;
+}
+#endif
+
+static int vfs_open_slot(vfs_context *ctx, int pos, const char* filename, int mode) {
+	vfs_handle *h = &ctx->handles[pos];
+	char *name = ctx->fnbuf + ctx->fnprefsize;
 	int len = strlen(filename);
-	if (len > (MAX_FNLEN - vfs_fnprefsize)) {
+	if (len > (MAX_FNLEN - ctx->fnprefsize)) {
 		return -1;
 	}
 
-	int pos = 0;
-	while (pos < MAX_FILES && file_pointers[pos] != NULL) pos++;
-	if (pos == MAX_FILES) return -1;
+	strncpy(name, filename, MAX_FNLEN - ctx->fnprefsize);
+	if (ctx->fnprefsize == 0) {
+		vfs_fix_case(ctx, name);
+	}
+
+#ifdef USE_PTHREADS
+	if (ctx->overlay != NULL) {
+		int id = vfs_overlay_open(ctx, name, mode);
+		if (id < -1) return -1;
+		if (id >= 0) {
+			h->overlay_id = id;
+			h->pos = 0;
+			strcpy(h->name, name);
+			h->mode = mode;
+			h->used = 1;
+			return pos+1;
+		}
+	}
+#endif
 
-	strncpy(vfs_fnbuf + vfs_fnprefsize, filename, MAX_FNLEN);
-	if (vfs_fnprefsize == 0) {
-		vfs_fix_case(vfs_fnbuf + vfs_fnprefsize);
+	if (ctx->mem != NULL) {
+		int id = mem_entry_find(ctx->mem, name);
+		if (id < 0 || (mode & 0x10003) != 0) return -1;
+		int size;
+		h->mem_id = id;
+		h->map = (u8*) mem_entry_data(ctx->mem, id, &size);
+		h->map_size = size;
+		h->pos = 0;
+		strcpy(h->name, name);
+		h->mode = mode;
+		h->used = 1;
+		return pos+1;
 	}
 
-	FILE* file = fopen(vfs_fnbuf, (mode & 0x10000) ? "w+b" : (((mode & 0x03) == 0) ? "rb" : "r+b"));
+	FILE* file = fopen(ctx->fnbuf, (mode & 0x10000) ? "w+b" : (((mode & 0x03) == 0) ? "rb" : "r+b"));
+#ifdef USE_ZLIB
+	if (file == NULL && ctx->zip != NULL) {
+		int id = zip_entry_find(ctx->zip, name);
+		if (id >= 0 && (mode & 0x03) == 0) {
+			int size;
+			const u8 *data = vfs_cas_acquire(ctx, id, &size, &h->cas_id);
+			if (data == NULL) {
+				data = zip_entry_acquire(ctx->zip, id, &size);
+				if (data == NULL) return -1;
+				h->zip_id = id;
+			}
+			h->map = (u8*) data;
+			h->map_size = size;
+			h->pos = 0;
+			strcpy(h->name, name);
+			h->mode = mode;
+			h->used = 1;
+			return pos+1;
+		} else if (id >= 0 && vfs_zip_copy_up(ctx, id, ctx->fnbuf) >= 0) {
+			// written to disk, where it shadows the archive
+			file = fopen(ctx->fnbuf, "r+b");
+		}
+	}
+#endif
 	if (file == NULL) {
-//		fprintf(stderr, "failed to open %s\n", vfs_fnbuf);
+//		fprintf(stderr, "failed to open %s\n", ctx->fnbuf);
 		return -1;
 	}
-	file_pointers[pos] = file;
+	if (mode & 0x10000) {
+		// the file may be new
+		vfs_index_invalidate(ctx);
+	}
+	h->file = file;
+	strcpy(h->name, name);
+	h->mode = mode;
+	h->used = 1;
+	h->prefetch_pending = 0;
+	h->seq_reads = 0;
+	h->read_end = 0;
+
+	// files read ahead are served from memory, others through stdio
+	struct stat st;
+	if ((mode & 0x10003) == 0 && fstat(fileno(file), &st) == 0) {
+		h->file_size = st.st_size;
+		h->file_mtime = vfs_stat_mtime_ns(&st);
+#ifdef USE_PTHREADS
+		vfs_prefetch_take(ctx, h);
+#endif
+	}
 	return pos+1;
 }
 
+static int vfs_open_at(vfs_context *ctx, int pos, const char* filename, int mode) {
+	int result = vfs_open_slot(ctx, pos, filename, mode);
+	if (result > 0) {
+		vfs_handle *h = &ctx->handles[pos];
+		h->stat_id = vfs_file_stat_find(ctx, h->name);
+		if (h->stat_id >= 0) ctx->file_stats[h->stat_id].opens++;
+	}
+	return result;
+}
+
+int vfs_open(const char* filename, int mode) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL) return -1;
+
+	u64 start = vfs_time_us();
+	int pos = vfs_handle_alloc(ctx);
+	int result = -1;
+	if (pos >= 0) {
+		result = vfs_open_at(ctx, pos, filename, mode);
+		if (result < 0) vfs_handle_free(ctx, pos);
+	}
+	vfs_stat_record(ctx, POSIX_VFS_STAT_OPEN, start, result < 0);
+	return result;
+}
+
+static int vfs_handle_read(vfs_context *ctx, vfs_handle *h, u8* ptr, int amount) {
+#ifdef USE_PTHREADS
+	// a handle whose copy already holds the whole file has nothing to gain
+	if (h->file != NULL && h->map == NULL && ctx->prefetch_mode != POSIX_VFS_PREFETCH_OFF && (h->mode & 0x10003) == 0) {
+		vfs_prefetch_track(ctx, h, amount);
+	}
+	if (h->overlay_id >= 0) {
+		amount = overlay_file_read(ctx->overlay, h->overlay_id, h->pos, ptr, amount);
+		h->pos += amount;
+		return amount;
+	}
+#endif
+	if (h->map != NULL) {
+		long avail = h->map_size - h->pos;
+		if (amount > avail) amount = avail > 0 ? avail : 0;
+		if (amount > 0) {
+			memcpy(ptr, h->map + h->pos, amount);
+			h->pos += amount;
+		}
+		return amount;
+	}
+	return fread(ptr, 1, amount, h->file);
+}
+
 int vfs_read(int handle, u8* ptr, int amount) {
-	if (handle <= 0 || handle > MAX_FILES) return -1;
-	FILE* fptr = file_pointers[handle-1];
-	return fread(ptr, 1, amount, fptr);
+	vfs_context *ctx = vfs_ctx();
+	vfs_handle *h = vfs_get_handle(ctx, handle);
+	if (h == NULL) return -1;
+
+	u64 start = vfs_time_us();
+	int result = vfs_handle_read(ctx, h, ptr, amount);
+	vfs_stat_record(ctx, POSIX_VFS_STAT_READ, start, result < 0);
+	posix_vfs_file_stats *fs = vfs_file_stat(ctx, h);
+	if (fs != NULL) fs->reads++;
+	if (result > 0) {
+		ctx->stats.bytes_read += result;
+		if (fs != NULL) fs->bytes_read += result;
+	}
+	return result;
+}
+
+#ifdef POSIX_VFS_READ_COPY
+// copies a file opened for reading into memory; empty and very large
+// files stay on stdio
+static void vfs_handle_copy(vfs_context *ctx, vfs_handle *h) {
+	if (h->file == NULL || (h->mode & 0x10003) != 0) return;
+#ifdef USE_PTHREADS
+	if (vfs_prefetch_take(ctx, h) > 0) return;
+	h->prefetch_pending = 0;
+#endif
+	if (h->file_size <= 0 || h->file_size > POSIX_VFS_READ_COPY_MAX) return;
+
+	u8 *data = malloc(h->file_size);
+	if (data == NULL) return;
+	long pos = ftell(h->file);
+	if (fseek(h->file, 0, SEEK_SET) != 0) {
+		free(data);
+		return;
+	}
+	// the file may have shrunk since
+	h->map = data;
+	h->map_size = fread(data, 1, h->file_size, h->file);
+	h->pos = pos;
+}
+#endif
+
+const u8* vfs_get_data(int handle, int* len) {
+	vfs_context *ctx = vfs_ctx();
+	vfs_handle *h = vfs_get_handle(ctx, handle);
+	if (h == NULL) return NULL;
+#ifdef POSIX_VFS_READ_COPY
+	if (h->map == NULL) vfs_handle_copy(ctx, h);
+#endif
+	if (h->map == NULL) return NULL;
+	*len = (int) h->map_size;
+	return h->map;
+}
+
+static int vfs_handle_write(vfs_context *ctx, vfs_handle *h, u8* ptr, int amount) {
+#ifdef USE_PTHREADS
+	if (h->overlay_id >= 0) {
+		if ((h->mode & 0x03) == 0) return -1;
+		amount = overlay_file_write(ctx->overlay, h->overlay_id, h->pos, ptr, amount);
+		if (amount > 0) h->pos += amount;
+		return amount;
+	}
+#endif
+	if (h->file == NULL) return -1;
+	return fwrite(ptr, 1, amount, h->file);
 }
 
 int vfs_write(int handle, u8* ptr, int amount) {
-	if (handle <= 0 || handle > MAX_FILES) return -1;
-	FILE* fptr = file_pointers[handle-1];
-	return fwrite(ptr, 1, amount, fptr);
+	vfs_context *ctx = vfs_ctx();
+	vfs_handle *h = vfs_get_handle(ctx, handle);
+	if (h == NULL) return -1;
+
+	u64 start = vfs_time_us();
+	int result = vfs_handle_write(ctx, h, ptr, amount);
+	vfs_stat_record(ctx, POSIX_VFS_STAT_WRITE, start, result < 0);
+	posix_vfs_file_stats *fs = vfs_file_stat(ctx, h);
+	if (fs != NULL) fs->writes++;
+	if (result > 0) {
+		ctx->stats.bytes_written += result;
+		if (fs != NULL) fs->bytes_written += result;
+	}
+	return result;
 }
 
-int vfs_seek(int handle, int amount, int type) {
-	if (handle <= 0 || handle > MAX_FILES) return -1;
-	FILE* fptr = file_pointers[handle-1];
+static int vfs_handle_seek(vfs_context *ctx, vfs_handle *h, int amount, int type) {
+	if (h->map != NULL || h->overlay_id >= 0) {
+		long pos, size = h->map_size;
+#ifdef USE_PTHREADS
+		if (h->overlay_id >= 0) size = overlay_file_size(ctx->overlay, h->overlay_id);
+#endif
+		switch (type) {
+			default:
+			case VFS_SEEK_SET: pos = amount; break;
+			case VFS_SEEK_CUR: pos = h->pos + amount; break;
+			case VFS_SEEK_END: pos = size + amount; break;
+		}
+		if (pos < 0) return -1;
+		h->pos = pos;
+		return 0;
+	}
 	switch (type) {
 		default:
-		case VFS_SEEK_SET: return fseek(fptr, amount, SEEK_SET);
-		case VFS_SEEK_CUR: return fseek(fptr, amount, SEEK_CUR);
-		case VFS_SEEK_END: return fseek(fptr, amount, SEEK_END);
+		case VFS_SEEK_SET: return fseek(h->file, amount, SEEK_SET);
+		case VFS_SEEK_CUR: return fseek(h->file, amount, SEEK_CUR);
+		case VFS_SEEK_END: return fseek(h->file, amount, SEEK_END);
 	}
 }
 
+int vfs_seek(int handle, int amount, int type) {
+	vfs_context *ctx = vfs_ctx();
+	vfs_handle *h = vfs_get_handle(ctx, handle);
+	if (h == NULL) return -1;
+
+	u64 start = vfs_time_us();
+	int result = vfs_handle_seek(ctx, h, amount, type);
+	vfs_stat_record(ctx, POSIX_VFS_STAT_SEEK, start, result < 0);
+	posix_vfs_file_stats *fs = vfs_file_stat(ctx, h);
+	if (fs != NULL) fs->seeks++;
+	return result;
+}
+
 int vfs_close(int handle) {
-	if (handle <= 0 || handle > MAX_FILES) return -1;
-	FILE* fptr = file_pointers[handle-1];
-	file_pointers[handle-1] = NULL;
-	return fclose(fptr);
+	vfs_context *ctx = vfs_ctx();
+	if (vfs_get_handle(ctx, handle) == NULL) return -1;
+
+	u64 start = vfs_time_us();
+	int result = vfs_release(ctx, handle-1);
+	vfs_handle_free(ctx, handle-1);
+	vfs_stat_record(ctx, POSIX_VFS_STAT_CLOSE, start, result < 0);
+	return result;
+}
+
+// handle table state, for machine snapshots
+
+int posix_vfs_save_handles(u8* data, int len) {
+	vfs_context *ctx = vfs_ctx();
+	int pos = 1;
+	int count = 0;
+
+	if (ctx == NULL || len < 1) return -1;
+
+	for (int i = 0; i < ctx->handle_count; i++) {
+		vfs_handle *h = &ctx->handles[i];
+		if (!h->used) continue;
+		int name_len = strlen(h->name);
+		if ((pos + 8 + name_len) > len || count >= 255) return -1;
+
+		long fpos = (h->map != NULL || h->overlay_id >= 0) ? h->pos : ftell(h->file);
+		int mode = h->mode & (~VFS_OPEN_TRUNCATE);
+		data[pos++] = i;
+		data[pos++] = mode & 0xFF;
+		data[pos++] = (mode >> 8) & 0xFF;
+		data[pos++] = fpos & 0xFF;
+		data[pos++] = (fpos >> 8) & 0xFF;
+		data[pos++] = (fpos >> 16) & 0xFF;
+		data[pos++] = (fpos >> 24) & 0xFF;
+		data[pos++] = name_len;
+		memcpy(data + pos, h->name, name_len);
+		pos += name_len;
+		count++;
+	}
+
+	data[0] = count;
+	return pos;
+}
+
+int posix_vfs_load_handles(const u8* data, int len) {
+	vfs_context *ctx = vfs_ctx();
+	int pos = 1;
+	int result = 0;
+	char name[MAX_FNLEN+1];
+
+	if (ctx == NULL || len < 1) return -1;
+
+	vfs_release_all(ctx);
+
+	for (int i = 0; i < data[0]; i++) {
+		if ((pos + 8) > len) {
+			result = -1;
+			break;
+		}
+		int idx = data[pos];
+		int mode = data[pos + 1] | (data[pos + 2] << 8);
+		long fpos = data[pos + 3] | (data[pos + 4] << 8) | (data[pos + 5] << 16) | ((long) data[pos + 6] << 24);
+		int name_len = data[pos + 7];
+		pos += 8;
+		if ((pos + name_len) > len) {
+			result = -1;
+			break;
+		}
+
+		memcpy(name, data + pos, name_len);
+		name[name_len] = 0;
+		pos += name_len;
+
+		int count = ctx->handle_count;
+		while (count <= idx) count *= 2;
+		if (vfs_handles_grow(ctx, count < VFS_MAX_HANDLES ? count : VFS_MAX_HANDLES) < 0 || vfs_open_at(ctx, idx, name, mode) < 0) {
+			fprintf(stderr, "could not reopen %s\n", name);
+			result = -1;
+			continue;
+		}
+		vfs_handle_seek(ctx, &ctx->handles[idx], fpos, VFS_SEEK_SET);
+	}
+
+	// slots were taken directly, not from the free list
+	vfs_handles_rebuild_free(ctx);
+	return result;
+}
+
+// forks
+//
+// The files of a fork are its handle table, as saved for snapshots, and
+// a copy of the private overlay, which files open for writing are moved
+// to once the first fork is made. When the last fork is freed, the files
+// written meanwhile are passed on to the overlay used otherwise, or
+// written to disk, and the files open for writing are moved back.
+
+#ifdef USE_PTHREADS
+#define VFS_FORK_HANDLES_MAX (1 + VFS_MAX_HANDLES * (8 + MAX_FNLEN))
+
+// reopens files open for writing, and files in an overlay, in the
+// current overlay
+static void vfs_fork_reopen(vfs_context *ctx) {
+	char name[MAX_FNLEN+1];
+
+	for (int i = 0; i < ctx->handle_count; i++) {
+		vfs_handle *h = &ctx->handles[i];
+		if (!h->used || (h->overlay_id < 0 && (h->mode & 0x10003) == 0)) continue;
+
+		long fpos = h->overlay_id >= 0 ? h->pos : ftell(h->file);
+		int mode = h->mode & (~VFS_OPEN_TRUNCATE);
+		strcpy(name, h->name);
+		vfs_release(ctx, i);
+		if (vfs_open_at(ctx, i, name, mode) < 0) {
+			fprintf(stderr, "could not reopen %s\n", name);
+			continue;
+		}
+		vfs_handle_seek(ctx, h, fpos, VFS_SEEK_SET);
+	}
+	vfs_handles_rebuild_free(ctx);
+}
+
+static int vfs_fork_begin(vfs_context *ctx) {
+	overlay_store *overlay = overlay_store_open(NULL, 0, OVERLAY_SYNC_NONE);
+	if (overlay == NULL) return -1;
+
+	// files in memory are carried over unwritten, as the base overlay
+	// still saves them
+	for (int i = 0; ctx->overlay != NULL && i < overlay_file_count(ctx->overlay); i++) {
+		int size = overlay_file_size(ctx->overlay, i);
+		u8 *data = malloc(size > 0 ? size : 1);
+		int id = -1;
+		if (data != NULL) {
+			overlay_file_read(ctx->overlay, i, 0, data, size);
+			id = overlay_file_create(overlay, overlay_file_name(ctx->overlay, i), data, size);
+			free(data);
+		}
+		if (id < 0) {
+			overlay_store_close(overlay);
+			return -1;
+		}
+	}
+
+	ctx->overlay_base = ctx->overlay;
+	ctx->overlay = overlay;
+	ctx->branching = 1;
+	vfs_fork_reopen(ctx);
+	return 0;
+}
+
+static int vfs_fork_commit(vfs_context *ctx, const char *name, const u8 *data, int len) {
+	char path[MAX_FNLEN + 1];
+
+	if (ctx->overlay_base != NULL) {
+		int id = overlay_file_find(ctx->overlay_base, name);
+		if (id < 0) id = overlay_file_create(ctx->overlay_base, name, NULL, 0);
+		if (id < 0) return -1;
+		overlay_file_truncate(ctx->overlay_base, id);
+		return overlay_file_write(ctx->overlay_base, id, 0, data, len) == len ? 0 : -1;
+	}
+
+	if (ctx->fnprefsize + strlen(name) > MAX_FNLEN) return -1;
+	snprintf(path, sizeof(path), "%.*s%s", ctx->fnprefsize, ctx->fnbuf, name);
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) return -1;
+	int ok = (len == 0 || fwrite(data, len, 1, file) == 1);
+	ok &= fclose(file) == 0;
+	return ok ? 0 : -1;
+}
+
+static void vfs_fork_end(vfs_context *ctx) {
+	overlay_store *overlay = ctx->overlay;
+
+	for (int i = 0; i < overlay_file_count(overlay); i++) {
+		if (!overlay_file_written(overlay, i)) continue;
+		const char *name = overlay_file_name(overlay, i);
+		int size = overlay_file_size(overlay, i);
+		u8 *data = malloc(size > 0 ? size : 1);
+		if (data != NULL) overlay_file_read(overlay, i, 0, data, size);
+		if (data == NULL || vfs_fork_commit(ctx, name, data, size) < 0) {
+			fprintf(stderr, "Could not save %s!\n", name);
+		}
+		free(data);
+	}
+
+	ctx->overlay = ctx->overlay_base;
+	ctx->overlay_base = NULL;
+	ctx->branching = 0;
+	vfs_fork_reopen(ctx);
+	if (overlay_file_count(overlay) > 0) vfs_index_invalidate(ctx);
+	overlay_store_close(overlay);
+}
+
+int vfs_fork_create(int id) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL || id < 0) return -1;
+
+	if (id >= ctx->fork_size) {
+		int size_new = ctx->fork_size > 0 ? ctx->fork_size : 16;
+		while (size_new <= id) size_new *= 2;
+		vfs_fork *forks_new = realloc(ctx->forks, sizeof(vfs_fork) * size_new);
+		if (forks_new == NULL) return -1;
+		memset(forks_new + ctx->fork_size, 0, sizeof(vfs_fork) * (size_new - ctx->fork_size));
+		ctx->forks = forks_new;
+		ctx->fork_size = size_new;
+	}
+	vfs_fork *f = &ctx->forks[id];
+	if (f->overlay != NULL) return -1;
+	if (!ctx->branching && vfs_fork_begin(ctx) < 0) return -1;
+
+	u8 *handles = malloc(VFS_FORK_HANDLES_MAX);
+	int handles_len = (handles != NULL) ? posix_vfs_save_handles(handles, VFS_FORK_HANDLES_MAX) : -1;
+	f->overlay = (handles_len > 0) ? overlay_store_copy(ctx->overlay) : NULL;
+	if (f->overlay == NULL) {
+		free(handles);
+		if (ctx->fork_count == 0) vfs_fork_end(ctx);
+		return -1;
+	}
+	u8 *handles_fit = realloc(handles, handles_len);
+	f->handles = (handles_fit != NULL) ? handles_fit : handles;
+	f->handles_len = handles_len;
+	ctx->fork_count++;
+	return 0;
+}
+
+int vfs_fork_switch(int id) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL || id < 0 || id >= ctx->fork_size || ctx->forks[id].overlay == NULL) return -1;
+	vfs_fork *f = &ctx->forks[id];
+
+	overlay_store *overlay = overlay_store_copy(f->overlay);
+	u8 *handles = malloc(VFS_FORK_HANDLES_MAX);
+	if (overlay == NULL || handles == NULL) {
+		if (overlay != NULL) overlay_store_close(overlay);
+		free(handles);
+		return -1;
+	}
+	int handles_len = posix_vfs_save_handles(handles, VFS_FORK_HANDLES_MAX);
+	int moved = handles_len != f->handles_len || memcmp(handles, f->handles, handles_len) != 0;
+	free(handles);
+
+	overlay_store *overlay_old = ctx->overlay;
+	ctx->overlay = overlay;
+	// usually the same files are still open, at the same positions
+	if (moved) posix_vfs_load_handles(f->handles, f->handles_len);
+	else vfs_fork_reopen(ctx);
+	if (overlay_file_count(overlay_old) > 0 || overlay_file_count(overlay) > 0) vfs_index_invalidate(ctx);
+	overlay_store_close(overlay_old);
+	return 0;
+}
+
+void vfs_fork_free(int id) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL || id < 0 || id >= ctx->fork_size || ctx->forks[id].overlay == NULL) return;
+	vfs_fork *f = &ctx->forks[id];
+
+	overlay_store_close(f->overlay);
+	free(f->handles);
+	f->overlay = NULL;
+	f->handles = NULL;
+	if (--ctx->fork_count == 0) vfs_fork_end(ctx);
+}
+#else
+int vfs_fork_create(int id) {
+	return -1;
+}
+
+int vfs_fork_switch(int id) {
+	return -1;
+}
+
+void vfs_fork_free(int id) {
+}
+#endif
+
+// I/O statistics
+
+void posix_vfs_get_stats(posix_vfs_stats* stats) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx != NULL) *stats = ctx->stats;
+	else memset(stats, 0, sizeof(posix_vfs_stats));
+}
+
+int posix_vfs_get_file_stats(int index, posix_vfs_file_stats* stats) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL || index < 0 || index >= ctx->file_stat_count) return -1;
+	*stats = ctx->file_stats[index];
+	return 0;
+}
+
+void posix_vfs_reset_stats(void) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL) return;
+
+	memset(&ctx->stats, 0, sizeof(posix_vfs_stats));
+	for (int i = 0; i < ctx->file_stat_count; i++) {
+		free((char*) ctx->file_stats[i].name);
+	}
+	ctx->file_stat_count = 0;
+	for (int i = 0; i < ctx->handle_count; i++) {
+		ctx->handles[i].stat_id = -1;
+	}
+}
+
+static const char *vfs_stat_names[POSIX_VFS_STAT_COUNT] = {
+	"open", "close", "read", "write", "seek", "findfirst", "findnext"
+};
+
+static int vfs_file_stat_cmp(const void *a, const void *b) {
+	const posix_vfs_file_stats *fa = *((const posix_vfs_file_stats**) a);
+	const posix_vfs_file_stats *fb = *((const posix_vfs_file_stats**) b);
+	if (fa->bytes_read != fb->bytes_read) return fa->bytes_read < fb->bytes_read ? 1 : -1;
+	return fb->opens - fa->opens;
+}
+
+void posix_vfs_dump_stats(FILE* file) {
+	vfs_context *ctx = vfs_ctx();
+	if (ctx == NULL) return;
+	posix_vfs_stats *stats = &ctx->stats;
+
+	fprintf(file, "vfs: %llu bytes read, %llu bytes written\n",
+		(unsigned long long) stats->bytes_read, (unsigned long long) stats->bytes_written);
+	for (int op = 0; op < POSIX_VFS_STAT_COUNT; op++) {
+		if (stats->calls[op] == 0) continue;
+		fprintf(file, "vfs: %-9s %8u calls, %u failed, %.1f us avg, %u us max;",
+			vfs_stat_names[op], stats->calls[op], stats->failures[op],
+			(double) stats->total_us[op] / stats->calls[op], stats->max_us[op]);
+		for (int i = 0; i < POSIX_VFS_LATENCY_BUCKETS; i++) {
+			if (stats->latency[op][i] == 0) continue;
+			if (i == POSIX_VFS_LATENCY_BUCKETS - 1) fprintf(file, " >=%lu:%u", 1UL << (i - 1), stats->latency[op][i]);
+			else fprintf(file, " <%lu:%u", 1UL << i, stats->latency[op][i]);
+		}
+		fprintf(file, "\n");
+	}
+
+	posix_vfs_file_stats **sorted = malloc(sizeof(posix_vfs_file_stats*) * (ctx->file_stat_count + 1));
+	if (sorted == NULL) return;
+	for (int i = 0; i < ctx->file_stat_count; i++) {
+		sorted[i] = &ctx->file_stats[i];
+	}
+	qsort(sorted, ctx->file_stat_count, sizeof(posix_vfs_file_stats*), vfs_file_stat_cmp);
+	for (int i = 0; i < ctx->file_stat_count; i++) {
+		posix_vfs_file_stats *fs = sorted[i];
+		fprintf(file, "vfs: %-12s %6u opens, %7u reads (%llu bytes), %6u writes (%llu bytes), %6u seeks\n",
+			fs->name, fs->opens, fs->reads, (unsigned long long) fs->bytes_read,
+			fs->writes, (unsigned long long) fs->bytes_written, fs->seeks);
+	}
+	free(sorted);
 }
@@ -23,9 +23,124 @@
 #ifndef __POSIX_VFS_H__
 #define __POSIX_VFS_H__
 
+#include <stdio.h>
 #include "types.h"
 
+// all state is kept per context; the functions below, and the vfs_*
+// functions, act on the calling thread's current context, or the one
+// set up by the first init_posix_vfs() call if it has none. A context
+// is to be used by one thread at a time; separate contexts can be used
+// from separate threads
+typedef struct vfs_context vfs_context;
+
+USER_FUNCTION
+vfs_context* posix_vfs_context_create(const char* path);
+USER_FUNCTION
+void posix_vfs_context_free(vfs_context* ctx);
+USER_FUNCTION
+void posix_vfs_context_set_current(vfs_context* ctx);
+USER_FUNCTION
+vfs_context* posix_vfs_context_get_current(void);
+
+// (re)initializes the current context, creating the default one if none
 USER_FUNCTION
 void init_posix_vfs(const char* path);
 
+// serve files not found on disk from a ZIP archive, read-only - writing
+// copies the file to disk first; NULL to unmount. Fails while files from
+// the current archive are open, or when built without zlib
+USER_FUNCTION
+int posix_vfs_mount_zip(const char* filename);
+
+// unpack files served from ZIP archives into a content-addressed store
+// in directory, shared by every instance on the host using it, instead
+// of into memory; each file is then kept once per host, in pages shared
+// between processes. Files are checked when first mapped. Can only be
+// set once per process, for all contexts; fails when built without zlib
+// or where files cannot be mapped
+USER_FUNCTION
+int posix_vfs_set_cache(const char* directory);
+
+// serve all files from memory, preloading a directory or a ZIP archive
+// once; the disk is not touched afterwards. Writes are kept in memory,
+// unless an overlay is set. NULL to unmount. Fails while files from the
+// current bundle are open
+USER_FUNCTION
+int posix_vfs_mount_memory(const char* path);
+// copies the name of the first world (*.ZZT, by name) at the top level of
+// the mounted ZIP archive or memory bundle to name, ignoring files on
+// disk; returns -1 if there is none
+USER_FUNCTION
+int posix_vfs_find_mounted_world(char* name, int len);
+
+// keep files opened for writing in memory, saving changes to directory
+// in the background, in batches; files saved there earlier are read in
+// place of the ones in the VFS path. sync_mode is OVERLAY_SYNC_NONE (0)
+// or OVERLAY_SYNC_FILE (1). NULL to disable, saving pending changes.
+// Fails while overlay files are open, or when built without threads
+USER_FUNCTION
+int posix_vfs_set_overlay(const char* directory, int sync_mode);
+// blocks until pending overlay changes are saved
+USER_FUNCTION
+void posix_vfs_flush(void);
+
+// read files on disk ahead into memory on a background thread, shared
+// by all contexts: files noticed being read from start to end, and with
+// POSIX_VFS_PREFETCH_WORLDS also every world, board and save file in
+// the VFS path right away. Reads are then served from memory. Fails when
+// built without threads
+#define POSIX_VFS_PREFETCH_OFF 0
+#define POSIX_VFS_PREFETCH_SEQUENTIAL 1
+#define POSIX_VFS_PREFETCH_WORLDS 2
+
+USER_FUNCTION
+int posix_vfs_set_prefetch(int mode);
+
+// I/O statistics of the current context, kept since its creation or
+// the last reset; latencies are counted in buckets by powers of two,
+// bucket i holding calls which took less than 2^i microseconds (the
+// last one also holds all slower calls)
+#define POSIX_VFS_STAT_OPEN 0
+#define POSIX_VFS_STAT_CLOSE 1
+#define POSIX_VFS_STAT_READ 2
+#define POSIX_VFS_STAT_WRITE 3
+#define POSIX_VFS_STAT_SEEK 4
+#define POSIX_VFS_STAT_FINDFIRST 5
+#define POSIX_VFS_STAT_FINDNEXT 6
+#define POSIX_VFS_STAT_COUNT 7
+#define POSIX_VFS_LATENCY_BUCKETS 20
+
+typedef struct {
+	u32 calls[POSIX_VFS_STAT_COUNT];
+	u32 failures[POSIX_VFS_STAT_COUNT];
+	u64 total_us[POSIX_VFS_STAT_COUNT];
+	u32 max_us[POSIX_VFS_STAT_COUNT];
+	u32 latency[POSIX_VFS_STAT_COUNT][POSIX_VFS_LATENCY_BUCKETS];
+	u64 bytes_read, bytes_written;
+} posix_vfs_stats;
+
+// per file name, over all handles it was opened with
+typedef struct {
+	const char* name; // valid until the next reset
+	u32 opens, reads, writes, seeks;
+	u64 bytes_read, bytes_written;
+} posix_vfs_file_stats;
+
+USER_FUNCTION
+void posix_vfs_get_stats(posix_vfs_stats* stats);
+// returns -1 past the last file
+USER_FUNCTION
+int posix_vfs_get_file_stats(int index, posix_vfs_file_stats* stats);
+USER_FUNCTION
+void posix_vfs_reset_stats(void);
+// as text, most read files first
+USER_FUNCTION
+void posix_vfs_dump_stats(FILE* file);
+
+// open handle table, for machine snapshots
+USER_FUNCTION
+int posix_vfs_save_handles(u8* data, int len);
+USER_FUNCTION
+int posix_vfs_load_handles(const u8* data, int len);
+
 #endif
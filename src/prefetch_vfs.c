@@ -0,0 +1,264 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "prefetch_vfs.h"
+#include "vfs_util.h"
+
+#define PREFETCH_MAX_PATH 519
+
+#define PREFETCH_EMPTY 0
+#define PREFETCH_QUEUED 1
+#define PREFETCH_READ 2
+#define PREFETCH_FAILED 3
+
+typedef struct {
+	char path[PREFETCH_MAX_PATH + 1];
+	u32 hash;
+	int state;
+	u8 *data;
+	long size;
+	s64 mtime;
+	int refs;
+	u32 seq; // queue order while queued, last use once read
+} prefetch_file;
+
+struct prefetch_cache {
+	// slots are reused once empty, so IDs of acquired files stay valid
+	prefetch_file *files;
+	int file_count, file_size;
+	int queued;
+	long bytes, limit;
+	u32 seq;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int stop;
+};
+
+static int prefetch_find(prefetch_cache *cache, const char *path, u32 hash) {
+	for (int i = 0; i < cache->file_count; i++) {
+		prefetch_file *f = &cache->files[i];
+		if (f->state != PREFETCH_EMPTY && f->hash == hash && strcmp(f->path, path) == 0) return i;
+	}
+	return -1;
+}
+
+static void prefetch_drop(prefetch_cache *cache, prefetch_file *f) {
+	if (f->state == PREFETCH_READ) cache->bytes -= f->size;
+	free(f->data);
+	f->data = NULL;
+	f->state = PREFETCH_EMPTY;
+}
+
+// to be called with the lock held
+static void prefetch_evict(prefetch_cache *cache, long needed) {
+	while (cache->bytes + needed > cache->limit) {
+		int oldest = -1;
+		for (int i = 0; i < cache->file_count; i++) {
+			prefetch_file *f = &cache->files[i];
+			if (f->state == PREFETCH_READ && f->refs == 0
+				&& (oldest < 0 || (s32) (f->seq - cache->files[oldest].seq) < 0))
+			{
+				oldest = i;
+			}
+		}
+		if (oldest < 0) return;
+		prefetch_drop(cache, &cache->files[oldest]);
+	}
+}
+
+static u8 *prefetch_read(const char *path, long *size, s64 *mtime, long limit) {
+	struct stat st;
+	u8 *data = NULL;
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return NULL;
+	if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) && st.st_size <= limit) {
+		*size = st.st_size;
+		*mtime = vfs_stat_mtime_ns(&st);
+		data = malloc(*size > 0 ? *size : 1);
+		if (data != NULL && *size > 0 && fread(data, *size, 1, file) != 1) {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(file);
+	return data;
+}
+
+static void *prefetch_thread(void *arg) {
+	prefetch_cache *cache = (prefetch_cache*) arg;
+	char path[PREFETCH_MAX_PATH + 1];
+
+	pthread_mutex_lock(&cache->lock);
+	while (!cache->stop) {
+		if (cache->queued == 0) {
+			pthread_cond_wait(&cache->cond, &cache->lock);
+			continue;
+		}
+
+		// first come, first read
+		int id = -1;
+		for (int i = 0; i < cache->file_count; i++) {
+			prefetch_file *f = &cache->files[i];
+			if (f->state == PREFETCH_QUEUED && (id < 0 || (s32) (f->seq - cache->files[id].seq) < 0)) id = i;
+		}
+		strcpy(path, cache->files[id].path);
+		cache->queued--;
+
+		long size = 0;
+		s64 mtime = 0;
+		pthread_mutex_unlock(&cache->lock);
+		u8 *data = prefetch_read(path, &size, &mtime, cache->limit);
+		pthread_mutex_lock(&cache->lock);
+
+		// files is only reallocated with the lock held, so the entry is
+		// looked up again
+		prefetch_file *f = &cache->files[id];
+		if (data != NULL) prefetch_evict(cache, size);
+		if (data == NULL || cache->bytes + size > cache->limit) {
+			free(data);
+			f->state = PREFETCH_FAILED;
+			continue;
+		}
+		f->data = data;
+		f->size = size;
+		f->mtime = mtime;
+		f->seq = cache->seq++;
+		f->state = PREFETCH_READ;
+		cache->bytes += size;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return NULL;
+}
+
+prefetch_cache *prefetch_cache_open(long limit) {
+	prefetch_cache *cache = calloc(1, sizeof(prefetch_cache));
+	if (cache == NULL) return NULL;
+
+	cache->limit = limit;
+	pthread_mutex_init(&cache->lock, NULL);
+	pthread_cond_init(&cache->cond, NULL);
+	if (pthread_create(&cache->thread, NULL, prefetch_thread, cache) != 0) {
+		pthread_cond_destroy(&cache->cond);
+		pthread_mutex_destroy(&cache->lock);
+		free(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+void prefetch_cache_close(prefetch_cache *cache) {
+	pthread_mutex_lock(&cache->lock);
+	cache->stop = 1;
+	pthread_cond_broadcast(&cache->cond);
+	pthread_mutex_unlock(&cache->lock);
+	pthread_join(cache->thread, NULL);
+
+	for (int i = 0; i < cache->file_count; i++) {
+		free(cache->files[i].data);
+	}
+	free(cache->files);
+	pthread_cond_destroy(&cache->cond);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+void prefetch_file_request(prefetch_cache *cache, const char *path) {
+	u32 hash = vfs_path_hash(path);
+	int id;
+
+	if (strlen(path) > PREFETCH_MAX_PATH) return;
+
+	pthread_mutex_lock(&cache->lock);
+	id = prefetch_find(cache, path, hash);
+	if (id >= 0 && cache->files[id].state != PREFETCH_FAILED) {
+		pthread_mutex_unlock(&cache->lock);
+		return;
+	}
+
+	// a failed read may have been a passing error; reuse its slot
+	if (id < 0) {
+		for (id = 0; id < cache->file_count; id++) {
+			if (cache->files[id].state == PREFETCH_EMPTY) break;
+		}
+	}
+	if (id >= cache->file_size) {
+		int size_new = cache->file_size > 0 ? cache->file_size * 2 : 16;
+		prefetch_file *files_new = realloc(cache->files, sizeof(prefetch_file) * size_new);
+		if (files_new == NULL) {
+			pthread_mutex_unlock(&cache->lock);
+			return;
+		}
+		cache->files = files_new;
+		cache->file_size = size_new;
+	}
+	if (id >= cache->file_count) cache->file_count = id + 1;
+
+	prefetch_file *f = &cache->files[id];
+	strcpy(f->path, path);
+	f->hash = hash;
+	f->state = PREFETCH_QUEUED;
+	f->data = NULL;
+	f->size = 0;
+	f->refs = 0;
+	f->seq = cache->seq++;
+	if (cache->queued++ == 0) pthread_cond_broadcast(&cache->cond);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+const u8 *prefetch_file_acquire(prefetch_cache *cache, const char *path, long size, s64 mtime, int *len, int *id) {
+	const u8 *data = NULL;
+
+	pthread_mutex_lock(&cache->lock);
+	int i = prefetch_find(cache, path, vfs_path_hash(path));
+	*id = (i >= 0 && cache->files[i].state == PREFETCH_QUEUED) ? 0 : -1;
+	if (i >= 0 && cache->files[i].state == PREFETCH_READ) {
+		prefetch_file *f = &cache->files[i];
+		if (f->size == size && f->mtime == mtime) {
+			f->refs++;
+			f->seq = cache->seq++;
+			*len = f->size;
+			*id = i;
+			data = f->data;
+		} else if (f->refs == 0) {
+			// changed since; read it again when next requested
+			prefetch_drop(cache, f);
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return data;
+}
+
+void prefetch_file_release(prefetch_cache *cache, int id) {
+	pthread_mutex_lock(&cache->lock);
+	cache->files[id].refs--;
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __PREFETCH_VFS_H__
+#define __PREFETCH_VFS_H__
+
+#include "types.h"
+
+// whole files, read into memory ahead of time on a background I/O thread,
+// so that whoever reads them next does not wait on the disk. Files read
+// in are kept, up to a limit in bytes, until the least recently used ones
+// are evicted; files larger than the limit are not read
+#define PREFETCH_DEFAULT_LIMIT (64L << 20)
+
+typedef struct prefetch_cache prefetch_cache;
+
+prefetch_cache *prefetch_cache_open(long limit);
+// waits for the file being read, if any; no files may be acquired
+void prefetch_cache_close(prefetch_cache *cache);
+
+// queues a file to be read, unless it already is or was; files which
+// could not be read are tried again
+void prefetch_file_request(prefetch_cache *cache, const char *path);
+// the contents of a file, if read in and of the given size and modification
+// time (as given by vfs_stat_mtime_ns); valid until released. Otherwise
+// NULL, with id set to 0 while the file is yet to be read, and to -1 if it
+// will not be without a request
+const u8 *prefetch_file_acquire(prefetch_cache *cache, const char *path, long size, s64 mtime, int *len, int *id);
+void prefetch_file_release(prefetch_cache *cache, int id);
+
+#endif /* __PREFETCH_VFS_H__ */
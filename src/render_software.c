@@ -26,7 +26,7 @@
 
 #define POS_MUL (scr_width <= 40 ? 2 : 1)
 
-void render_software_rgb(u32 *buffer, int scr_width, int row_length, int flags, u8 *video, u8 *charset, int char_width, int char_height, u32 *palette) {
+void render_software_rgb_dirty(u32 *buffer, int scr_width, int row_length, int flags, u8 *video, u8 *charset, int char_width, int char_height, u32 *palette, u8 *dirty) {
 	int pos_mul = POS_MUL;
 	int pos = 0;
 
@@ -36,6 +36,8 @@ void render_software_rgb(u32 *buffer, int scr_width, int row_length, int flags,
 
 	for (int y = 0; y < 25; y++) {
 		for (int x = 0; x < scr_width; x++, pos += 2) {
+			if (dirty != NULL && !(dirty[pos >> 4] & (1 << ((pos >> 1) & 7)))) continue;
+
 			u8 chr = video[pos];
 			u8 col = video[pos + 1];
 
@@ -63,6 +65,10 @@ void render_software_rgb(u32 *buffer, int scr_width, int row_length, int flags,
 	}
 }
 
+void render_software_rgb(u32 *buffer, int scr_width, int row_length, int flags, u8 *video, u8 *charset, int char_width, int char_height, u32 *palette) {
+	render_software_rgb_dirty(buffer, scr_width, row_length, flags, video, charset, char_width, char_height, palette, NULL);
+}
+
 void render_software_paletted(u8 *buffer, int scr_width, int row_length, int flags, u8 *video, u8 *charset, int char_width, int char_height) {
 	int pos_mul = POS_MUL;
 	int pos = 0;
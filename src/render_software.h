@@ -30,6 +30,9 @@
 
 USER_FUNCTION
 void render_software_rgb(u32 *buffer, int scr_width, int row_length, int flags, u8 *video, u8 *charset, int char_width, int char_height, u32 *palette);
+// only redraws the cells set in dirty, a zzt_vram_get_dirty-style bitmap (NULL - all)
+USER_FUNCTION
+void render_software_rgb_dirty(u32 *buffer, int scr_width, int row_length, int flags, u8 *video, u8 *charset, int char_width, int char_height, u32 *palette, u8 *dirty);
 USER_FUNCTION
 void render_software_paletted(u8 *buffer, int scr_width, int row_length, int flags, u8 *video, u8 *charset, int char_width, int char_height);
 
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include "rle.h"
+
+int rle_encode(const u8 *src, int len, u8 *dst, int dst_len) {
+	int ip = 0, op = 0;
+	int lit_start = 0;
+
+	while (ip < len) {
+		int run = 1;
+		while ((ip + run) < len && run < RLE_MAX_RUN && src[ip + run] == src[ip]) run++;
+
+		if (run >= RLE_MIN_RUN || (ip + run) >= len) {
+			if (run < RLE_MIN_RUN) {
+				// tail end - flush as literal
+				ip += run;
+				run = 0;
+			}
+
+			// flush pending literals
+			while (lit_start < ip) {
+				int lit_len = ip - lit_start;
+				if (lit_len > RLE_MAX_LITERAL) lit_len = RLE_MAX_LITERAL;
+				if ((op + 1 + lit_len) > dst_len) return -1;
+				dst[op++] = lit_len - 1;
+				for (int i = 0; i < lit_len; i++)
+					dst[op++] = src[lit_start++];
+			}
+
+			if (run > 0) {
+				if ((op + 2) > dst_len) return -1;
+				dst[op++] = 0x80 + (run - RLE_MIN_RUN);
+				dst[op++] = src[ip];
+				ip += run;
+				lit_start = ip;
+			}
+		} else {
+			ip += run;
+		}
+	}
+
+	return op;
+}
+
+int rle_decode(const u8 *src, int len, u8 *dst, int dst_len) {
+	int ip = 0, op = 0;
+
+	while (ip < len) {
+		u8 c = src[ip++];
+		if (c < 0x80) {
+			int lit_len = c + 1;
+			if ((ip + lit_len) > len || (op + lit_len) > dst_len) return -1;
+			if (dst != NULL) {
+				for (int i = 0; i < lit_len; i++)
+					dst[op + i] = src[ip + i];
+			}
+			ip += lit_len;
+			op += lit_len;
+		} else {
+			int run = c - 0x80 + RLE_MIN_RUN;
+			if (ip >= len || (op + run) > dst_len) return -1;
+			if (dst != NULL) {
+				u8 v = src[ip];
+				for (int i = 0; i < run; i++)
+					dst[op + i] = v;
+			}
+			ip++;
+			op += run;
+		}
+	}
+
+	return op;
+}
@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __RLE_H__
+#define __RLE_H__
+
+#include "types.h"
+
+// Simple byte-oriented run-length coding, used for machine snapshots.
+// A control byte below 0x80 is followed by (c + 1) literal bytes;
+// otherwise, the following byte is repeated (c - 0x80 + RLE_MIN_RUN) times.
+#define RLE_MIN_RUN 3
+#define RLE_MAX_RUN (0x7F + RLE_MIN_RUN)
+#define RLE_MAX_LITERAL 0x80
+#define RLE_MAX_ENCODED_SIZE(len) ((len) + (((len) + RLE_MAX_LITERAL - 1) / RLE_MAX_LITERAL))
+
+int rle_encode(const u8 *src, int len, u8 *dst, int dst_len);
+// if dst is NULL, only the decoded length is computed
+int rle_decode(const u8 *src, int len, u8 *dst, int dst_len);
+
+#endif /* __RLE_H__ */
@@ -111,6 +111,8 @@ void speaker_off(int cycles) {
 static SDL_mutex *zzt_thread_lock;
 static SDL_cond *zzt_thread_cond;
 static u8 zzt_vram_copy[80*25*2];
+static u8 zzt_vram_ahead[80*25*2];
+static u8 zzt_vram_dirty[ZZT_VRAM_DIRTY_SIZE];
 static u8 zzt_thread_running;
 static atomic_int zzt_renderer_waiting = 0;
 static u8 video_blink = 1;
@@ -119,6 +121,11 @@ static u8 zzt_turbo = 0;
 static long first_timer_tick;
 static double timer_time;
 
+static double sdl_timer_interval(void) {
+	int speed = zzt_get_speed();
+	return (speed > 1) ? (SYS_TIMER_TIME / speed) : SYS_TIMER_TIME;
+}
+
 static Uint32 sdl_timer_thread(Uint32 interval, void *param) {
 	if (!zzt_thread_running) return 0;
 	long curr_timer_tick = zeta_time_ms();
@@ -128,15 +135,16 @@ static Uint32 sdl_timer_thread(Uint32 interval, void *param) {
 	atomic_fetch_sub(&zzt_renderer_waiting, 1);
 	zzt_mark_timer();
 
+	double tick_interval = sdl_timer_interval();
 	audio_time = zeta_time_ms();
-	timer_time += SYS_TIMER_TIME;
+	timer_time += tick_interval;
 	long duration = curr_timer_tick - first_timer_tick;
-	long tick_time = ((long) (timer_time + SYS_TIMER_TIME)) - duration;
+	long tick_time = ((long) (timer_time + tick_interval)) - duration;
 
 	while (tick_time <= 0) {
 		zzt_mark_timer();
-		timer_time += SYS_TIMER_TIME;
-		tick_time = ((long) (timer_time + SYS_TIMER_TIME)) - duration;
+		timer_time += tick_interval;
+		tick_time = ((long) (timer_time + tick_interval)) - duration;
 	}
 
 	SDL_CondBroadcast(zzt_thread_cond);
@@ -147,13 +155,15 @@ static Uint32 sdl_timer_thread(Uint32 interval, void *param) {
 static void sdl_timer_init(void) {
 	first_timer_tick = zeta_time_ms();
 	timer_time = 0;
-	SDL_AddTimer((int) SYS_TIMER_TIME, sdl_timer_thread, (void*)NULL);
+	SDL_AddTimer((int) sdl_timer_interval(), sdl_timer_thread, (void*)NULL);
 }
 
 static int sdl_is_blink_phase(long curr_time) {
 	return ((curr_time % (BLINK_TOGGLE_DURATION_MS*2)) >= BLINK_TOGGLE_DURATION_MS);
 }
 
+static void posix_zzt_boot_cache_update(void);
+
 // try to keep a budget of ~5ms per call
 
 static int zzt_thread_func(void *ptr) {
@@ -175,7 +185,8 @@ static int zzt_thread_func(void *ptr) {
 			}
 			SDL_CondBroadcast(zzt_thread_cond);
 			if (rcode == STATE_WAIT) {
-				if (zzt_turbo) zzt_mark_timer_turbo();
+				posix_zzt_boot_cache_update();
+				if (zzt_turbo || zzt_get_speed() == ZZT_SPEED_UNLIMITED) zzt_mark_timer_turbo();
 				else SDL_CondWaitTimeout(zzt_thread_cond, zzt_thread_lock, 20);
 			} else if (rcode == STATE_END) {
 				zzt_thread_running = 0;
@@ -298,6 +309,28 @@ extern sdl_renderer sdl_renderer_opengl;
 #endif
 extern sdl_renderer sdl_renderer_software;
 
+// the board atlas (-A) runs without a display, so SDL must not be
+// initialized for it; this scans the options without consuming them
+static int sdl_is_headless(int argc, char **argv) {
+#ifdef USE_GETOPT
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (strcmp(arg, "--") == 0) break;
+		if (arg[0] != '-') continue;
+		for (int j = 1; arg[j] != '\0'; j++) {
+			const char *opt = strchr(POSIX_ZZT_OPTIONS, arg[j]);
+			if (opt == NULL || arg[j] == ':') break;
+			if (arg[j] == 'A') return 1;
+			if (opt[1] == ':') {
+				if (arg[j + 1] == '\0') i++;
+				break;
+			}
+		}
+	}
+#endif
+	return 0;
+}
+
 int main(int argc, char **argv) {
 	int scancodes_lifted[sdl_to_pc_scancode_max + 1];
 	int slc = 0;
@@ -312,7 +345,9 @@ int main(int argc, char **argv) {
 
 	init_posix_vfs("");
 
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) < 0) {
+	int headless = sdl_is_headless(argc, argv);
+
+	if (!headless && SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) < 0) {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_Init failed! %s", SDL_GetError());
 		return 1;
 	}
@@ -324,10 +359,14 @@ int main(int argc, char **argv) {
 
 	if (posix_zzt_init(argc, argv) < 0) {
 		fprintf(stderr, "Could not load ZZT!\n");
-		SDL_Quit();
+		if (!headless) SDL_Quit();
 		return 1;
 	}
 
+	if (headless) {
+		return posix_zzt_atlas(charset_update_data, charw, charh, palette_update_data);
+	}
+
 	sdl_renderer *renderer = NULL;
 #ifdef USE_OPENGL
 	renderer = &sdl_renderer_opengl;
@@ -379,18 +418,43 @@ int main(int argc, char **argv) {
 
 	int should_render = 1;
 
+	// above normal speed, draw at most once per display refresh
+	long frame_ms = 1000 / 60;
+	long last_frame_time = 0;
+	{
+		SDL_DisplayMode mode;
+		if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0 && mode.refresh_rate > 0) {
+			frame_ms = 1000 / mode.refresh_rate;
+		}
+	}
+
 	while (cont_loop) {
 		if (!zzt_thread_running) { cont_loop = 0; break; }
 
 		atomic_fetch_add(&zzt_renderer_waiting, 1);
 		SDL_LockMutex(zzt_thread_lock);
 		atomic_fetch_sub(&zzt_renderer_waiting, 1);
-
-		u8* ram = zzt_get_ram();
-		should_render = memcmp(ram + 0xB8000, zzt_vram_copy, 80*25*2);
-		if (should_render) {
-			memcpy(zzt_vram_copy, ram + 0xB8000, 80*25*2);
-			renderer->update_vram(zzt_vram_copy);
+		// statistics dumps read the VFS, which the emulation thread uses
+		posix_zzt_log_drain();
+
+		int skip_frame = (zzt_turbo || zzt_get_speed() != 1)
+			&& (zeta_time_ms() - last_frame_time) < frame_ms;
+
+		u8* vram = zzt_get_ram() + 0xB8000;
+		if (skip_frame) {
+			should_render = 0;
+		} else if (posix_zzt_arg_run_ahead > 0 && zzt_run_ahead(posix_zzt_arg_run_ahead, zzt_vram_ahead) >= 0) {
+			should_render = memcmp(zzt_vram_ahead, zzt_vram_copy, 80*25*2);
+			if (should_render) {
+				memcpy(zzt_vram_copy, zzt_vram_ahead, 80*25*2);
+				renderer->update_vram(zzt_vram_copy, NULL);
+			}
+		} else {
+			should_render = zzt_vram_get_dirty(zzt_vram_dirty) > 0;
+			if (should_render) {
+				memcpy(zzt_vram_copy, vram, 80*25*2);
+				renderer->update_vram(zzt_vram_copy, zzt_vram_dirty);
+			}
 		}
 
 		zzt_mark_frame();
@@ -450,6 +514,11 @@ int main(int argc, char **argv) {
 						zzt_turbo = 1;
 						break;
 					}
+					if (event.key.keysym.sym == SDLK_F8) {
+						// hold to keep going back
+						zzt_rewind(zzt_rewind_count() > 1 ? 2 : 1);
+						break;
+					}
 					if (event.key.keysym.sym == SDLK_F6 && KEYMOD_CTRL(event.key.keysym.mod)) {
 						// audio writer
 						if (audio_writer_s == NULL) {
@@ -575,6 +644,11 @@ int main(int argc, char **argv) {
 		SDL_UnlockMutex(render_data_update_mutex);
 
 		long curr_time = zeta_time_ms();
+		if (skip_frame) {
+			SDL_Delay(1);
+			continue;
+		}
+		last_frame_time = curr_time;
 		int blink_mode = video_blink ? (sdl_is_blink_phase(curr_time) ? BLINK_MODE_2 : BLINK_MODE_1) : BLINK_MODE_NONE;
 		renderer->draw(zzt_vram_copy, blink_mode);
 	}
@@ -585,6 +659,8 @@ int main(int argc, char **argv) {
 	}
 
 	zzt_thread_running = 0;
+	SDL_WaitThread(zzt_thread, NULL);
+	posix_vfs_flush();
 	if (audio_device != 0) {
 		SDL_CloseAudioDevice(audio_device);
 	}
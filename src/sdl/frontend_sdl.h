@@ -48,7 +48,7 @@ typedef struct {
     void (*deinit)(void);
     void (*update_charset)(int, int, u8*);
     void (*update_palette)(u32*);
-    void (*update_vram)(u8*);
+    void (*update_vram)(u8*, u8*); /* vram, dirty cells (NULL - all) */
     void (*draw)(u8*, int);
     SDL_Window *(*get_window)(void);
     sdl_render_size (*get_render_size)(void);
@@ -387,7 +387,7 @@ static void sdl_render_opengl_update_palette(u32 *data_arg) {
 	force_update = 1;
 }
 
-static void sdl_render_opengl_update_vram(u8 *vram) {
+static void sdl_render_opengl_update_vram(u8 *vram, u8 *dirty) {
 	force_update = 1;
 }
 
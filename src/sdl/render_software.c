@@ -31,6 +31,11 @@ static u8* charset_update_data = NULL;
 static u32* palette_update_data = NULL;
 
 static SDL_Texture *playfieldtex = NULL;
+static u32 *playfield = NULL;
+static u8 playfield_dirty[ZZT_VRAM_DIRTY_SIZE];
+static int playfield_full_redraw = 1;
+static int playfield_blink_mode = -1;
+static int playfield_swidth = 0;
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
 static int charw, charh;
@@ -63,6 +68,7 @@ static void sdl_render_software_deinit(void) {
     if (playfieldtex != NULL) {
         SDL_DestroyTexture(playfieldtex);
     }
+    free(playfield);
 
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -80,22 +86,26 @@ static void sdl_render_software_update_charset(int charw_arg, int charh_arg, u8
         }
         
         playfieldtex = SDL_CreateTexture(renderer, pformat, SDL_TEXTUREACCESS_STREAMING, 80*charw, 25*charh);
+        free(playfield);
+        playfield = malloc(80*charw * 25*charh * sizeof(u32));
     }
+
+    playfield_full_redraw = 1;
 }
 
 static void sdl_render_software_update_palette(u32 *data_arg) {
     palette_update_data = data_arg;
+    playfield_full_redraw = 1;
 }
 
 static void sdl_render_software_draw(u8 *vram, int blink_mode) {
 	SDL_Rect dest;
-	void *buffer;
-	int w, h, pitch;
+	int w, h;
 
 	int swidth = (zzt_video_mode() & 2) ? 80 : 40;
 	int sflags = 0;
 
-	if (palette_update_data == NULL || charset_update_data == NULL) {
+	if (palette_update_data == NULL || charset_update_data == NULL || playfield == NULL) {
 		return;
 	}
 
@@ -111,15 +121,51 @@ static void sdl_render_software_draw(u8 *vram, int blink_mode) {
 	SDL_GetRendererOutputSize(renderer, &w, &h);
 	calc_render_area(&dest, w, h, NULL, 0);
 
-	SDL_LockTexture(playfieldtex, NULL, &buffer, &pitch);
-	render_software_rgb(
-		buffer,
-		swidth, pitch / 4, sflags,
-		vram, charset_update_data,
-		charw, charh,
-		palette_update_data
-	);
-	SDL_UnlockTexture(playfieldtex);
+	if (swidth != playfield_swidth) {
+		playfield_swidth = swidth;
+		playfield_full_redraw = 1;
+	}
+
+	if (blink_mode != playfield_blink_mode) {
+		// blinking cells change appearance
+		playfield_blink_mode = blink_mode;
+		for (int i = 0; i < 80*25; i++) {
+			if (vram[i*2 + 1] >= 0x80) playfield_dirty[i >> 3] |= 1 << (i & 7);
+		}
+	}
+
+	// only redraw and upload the rows with changed cells
+	int first_row = 25, last_row = -1;
+	if (playfield_full_redraw) {
+		first_row = 0;
+		last_row = 24;
+	} else {
+		for (int i = 0; i < ZZT_VRAM_DIRTY_SIZE; i++) {
+			if (playfield_dirty[i] == 0) continue;
+			int row_first = (i * 8) / swidth;
+			int row_last = (i * 8 + 7) / swidth;
+			if (row_first < first_row) first_row = row_first;
+			if (row_last > last_row) last_row = row_last;
+		}
+		if (last_row > 24) last_row = 24;
+	}
+
+	if (first_row <= last_row) {
+		SDL_Rect rows = {0, first_row * charh, 80*charw, (last_row - first_row + 1) * charh};
+
+		render_software_rgb_dirty(
+			playfield,
+			swidth, 80*charw, sflags,
+			vram, charset_update_data,
+			charw, charh,
+			palette_update_data,
+			playfield_full_redraw ? NULL : playfield_dirty
+		);
+		SDL_UpdateTexture(playfieldtex, &rows, playfield + (rows.y * 80*charw), 80*charw * sizeof(u32));
+	}
+
+	memset(playfield_dirty, 0, sizeof(playfield_dirty));
+	playfield_full_redraw = 0;
 
 	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
 	SDL_RenderClear(renderer);
@@ -132,8 +178,15 @@ static SDL_Window *sdl_render_software_get_window(void) {
     return window;
 }
 
-static void sdl_render_software_update_vram(u8 *vram) {
-    // pass
+static void sdl_render_software_update_vram(u8 *vram, u8 *dirty) {
+	if (dirty == NULL) {
+		playfield_full_redraw = 1;
+		return;
+	}
+
+	for (int i = 0; i < ZZT_VRAM_DIRTY_SIZE; i++) {
+		playfield_dirty[i] |= dirty[i];
+	}
 }
 
 static sdl_render_size sdl_render_software_get_render_size(void) {
@@ -46,6 +46,8 @@ typedef signed int s32;
 typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned int u32;
+typedef signed long long s64;
+typedef unsigned long long u64;
 #else
 #include <3ds.h>
 #endif
@@ -0,0 +1,190 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include "vfs_util.h"
+
+#define FNV32_OFFSET 2166136261U
+#define FNV32_PRIME 16777619U
+
+u32 vfs_name_hash(const char *name) {
+	u32 h = FNV32_OFFSET;
+	for (; *name != 0; name++) {
+		u8 c = (u8) *name;
+		if (c >= 'A' && c <= 'Z') c += 32;
+		h = (h ^ c) * FNV32_PRIME;
+	}
+	return h;
+}
+
+u32 vfs_path_hash(const char *path) {
+	u32 h = FNV32_OFFSET;
+	for (; *path != 0; path++) {
+		h = (h ^ (u8) *path) * FNV32_PRIME;
+	}
+	return h;
+}
+
+u32 vfs_dos_time(time_t t) {
+	struct tm tm;
+#ifdef _WIN32
+	tm = *localtime(&t);
+#else
+	localtime_r(&t, &tm);
+#endif
+	// DOS dates start at 1980
+	if (tm.tm_year < 80) return (1 << 5 | 1) << 16;
+	return (u32) ((tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday) << 16
+		| (tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2);
+}
+
+s64 vfs_stat_mtime_ns(const struct stat *st) {
+#if defined(__APPLE__)
+	return (s64) st->st_mtimespec.tv_sec * 1000000000 + st->st_mtimespec.tv_nsec;
+#elif defined(__unix__)
+	return (s64) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#else
+	return (s64) st->st_mtime * 1000000000;
+#endif
+}
+
+static atomic_uint vfs_write_counter;
+
+int vfs_write_file(const char *path, const void *data, long size, int sync) {
+	long tmp_len = strlen(path) + 32;
+	char *tmp_path = malloc(tmp_len);
+	if (tmp_path == NULL) return -1;
+
+	// unique to the process and the call, as other instances and other
+	// threads may be writing the same file
+	snprintf(tmp_path, tmp_len, "%s.%ld.%u.tmp", path, (long) getpid(),
+		atomic_fetch_add_explicit(&vfs_write_counter, 1, memory_order_relaxed));
+
+	FILE *file = fopen(tmp_path, "wb");
+	if (file == NULL) {
+		free(tmp_path);
+		return -1;
+	}
+	int ok = (size == 0 || fwrite(data, size, 1, file) == 1);
+	ok &= fflush(file) == 0;
+	if (ok && sync) {
+#ifdef _WIN32
+		ok &= _commit(_fileno(file)) == 0;
+#else
+		ok &= fsync(fileno(file)) == 0;
+#endif
+	}
+	ok &= fclose(file) == 0;
+#ifdef _WIN32
+	// rename does not replace existing files
+	if (ok) remove(path);
+#endif
+	if (!ok || rename(tmp_path, path) != 0) {
+		remove(tmp_path);
+		free(tmp_path);
+		return -1;
+	}
+	free(tmp_path);
+	return 0;
+}
+
+static const u32 vfs_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define VFS_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void vfs_sha256_block(u32 *state, const u8 *p) {
+	u32 w[64];
+	u32 a = state[0], b = state[1], c = state[2], d = state[3];
+	u32 e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for (int i = 0; i < 16; i++) {
+		w[i] = ((u32) p[i * 4] << 24) | ((u32) p[i * 4 + 1] << 16) | ((u32) p[i * 4 + 2] << 8) | p[i * 4 + 3];
+	}
+	for (int i = 16; i < 64; i++) {
+		u32 s0 = VFS_ROR(w[i - 15], 7) ^ VFS_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		u32 s1 = VFS_ROR(w[i - 2], 17) ^ VFS_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	for (int i = 0; i < 64; i++) {
+		u32 t1 = h + (VFS_ROR(e, 6) ^ VFS_ROR(e, 11) ^ VFS_ROR(e, 25)) + ((e & f) ^ (~e & g)) + vfs_sha256_k[i] + w[i];
+		u32 t2 = (VFS_ROR(a, 2) ^ VFS_ROR(a, 13) ^ VFS_ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void vfs_sha256(const u8 *data, long len, u8 *out) {
+	u32 state[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	u8 block[64];
+	long pos = 0;
+
+	for (; pos + 64 <= len; pos += 64) {
+		vfs_sha256_block(state, data + pos);
+	}
+	int rest = len - pos;
+	memcpy(block, data + pos, rest);
+	block[rest++] = 0x80;
+	if (rest > 56) {
+		memset(block + rest, 0, 64 - rest);
+		vfs_sha256_block(state, block);
+		rest = 0;
+	}
+	memset(block + rest, 0, 56 - rest);
+	u64 bits = (u64) len * 8;
+	for (int i = 0; i < 8; i++) {
+		block[56 + i] = (bits >> (56 - i * 8)) & 0xFF;
+	}
+	vfs_sha256_block(state, block);
+
+	for (int i = 0; i < 8; i++) {
+		out[i * 4] = state[i] >> 24;
+		out[i * 4 + 1] = (state[i] >> 16) & 0xFF;
+		out[i * 4 + 2] = (state[i] >> 8) & 0xFF;
+		out[i * 4 + 3] = state[i] & 0xFF;
+	}
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __VFS_UTIL_H__
+#define __VFS_UTIL_H__
+
+#include <time.h>
+#include <sys/stat.h>
+#include "types.h"
+
+// helpers shared by the VFS modules
+
+// FNV-1a hash of a file name, folding ASCII case, as DOS names are
+// looked up case-insensitively
+u32 vfs_name_hash(const char *name);
+// FNV-1a hash of a host path, as is
+u32 vfs_path_hash(const char *path);
+
+// a host timestamp as a DOS date (high word) and time (low word), in
+// local time; times before 1980 become 1980-01-01
+u32 vfs_dos_time(time_t t);
+// a file's modification time in nanoseconds, as precise as the platform
+// reports it; to tell whether a file changed, not what time it is
+s64 vfs_stat_mtime_ns(const struct stat *st);
+
+// writes a whole file under a temporary name, then renames it into place,
+// so that a crash or a concurrent reader never sees it partially written;
+// with sync set, the data reaches the disk first. Returns 0 or -1
+int vfs_write_file(const char *path, const void *data, long size, int sync);
+
+#define VFS_SHA256_SIZE 32
+
+// SHA-256 of len bytes, into VFS_SHA256_SIZE bytes of out
+void vfs_sha256(const u8 *data, long len, u8 *out);
+
+#endif /* __VFS_UTIL_H__ */
@@ -0,0 +1,370 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+#include "zip_vfs.h"
+#include "vfs_util.h"
+
+#define ZIP_READ16(p, i) ((p)[(i)] | ((p)[(i) + 1] << 8))
+#define ZIP_READ32(p, i) ((u32) ZIP_READ16(p, i) | ((u32) ZIP_READ16(p, (i) + 2) << 16))
+
+#define ZIP_EOCD_SIZE 22
+#define ZIP_EOCD_SEARCH_MAX (ZIP_EOCD_SIZE + 65535) /* comment length is 16-bit */
+#define ZIP_CDIR_ENTRY_SIZE 46
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_INFLATE_CHUNK 16384
+
+typedef struct {
+	char *name;
+	u32 hash; // of the case-folded name
+	u32 offset; // of the local header
+	u32 comp_size, size, crc;
+	u32 dos_time; // date << 16 | time, as stored
+	int method;
+	u8 digest[VFS_SHA256_SIZE];
+	int has_digest;
+
+	u8 *data; // NULL if not cached
+	int refs;
+	u32 last_use;
+} zip_entry;
+
+struct zip_archive {
+	FILE *file;
+	char *names; // one allocation for all entry names
+	zip_entry *entries;
+	int entry_count;
+	int *table; // entry ID + 1, or 0 if empty
+	int table_mask;
+
+	int *cached; // IDs of entries with data
+	int cached_count;
+	long cached_bytes, cache_limit;
+	u32 use_counter;
+};
+
+static int zip_read_at(FILE *file, long offset, u8 *buffer, int len) {
+	if (fseek(file, offset, SEEK_SET) != 0) return -1;
+	return fread(buffer, 1, len, file) == (size_t) len ? 0 : -1;
+}
+
+static int zip_read_directory(zip_archive *zip) {
+	u8 *tail, *cdir;
+	int tail_len, eocd = -1;
+
+	if (fseek(zip->file, 0, SEEK_END) != 0) return -1;
+	long file_len = ftell(zip->file);
+	if (file_len < ZIP_EOCD_SIZE) return -1;
+
+	// the end of central directory record is followed only by a comment
+	tail_len = file_len < ZIP_EOCD_SEARCH_MAX ? (int) file_len : ZIP_EOCD_SEARCH_MAX;
+	tail = malloc(tail_len);
+	if (tail == NULL || zip_read_at(zip->file, file_len - tail_len, tail, tail_len) < 0) {
+		free(tail);
+		return -1;
+	}
+	for (int i = tail_len - ZIP_EOCD_SIZE; i >= 0; i--) {
+		if (ZIP_READ32(tail, i) == 0x06054B50) {
+			eocd = i;
+			break;
+		}
+	}
+	if (eocd < 0) {
+		free(tail);
+		return -1;
+	}
+
+	int count = ZIP_READ16(tail, eocd + 10);
+	u32 cdir_size = ZIP_READ32(tail, eocd + 12);
+	u32 cdir_offset = ZIP_READ32(tail, eocd + 16);
+	free(tail);
+	if (cdir_offset + (long) cdir_size > file_len) return -1;
+
+	cdir = malloc(cdir_size + 1);
+	if (cdir == NULL || zip_read_at(zip->file, cdir_offset, cdir, cdir_size) < 0) {
+		free(cdir);
+		return -1;
+	}
+
+	// names are at most as long as the directory itself
+	zip->entries = malloc(sizeof(zip_entry) * (count > 0 ? count : 1));
+	zip->names = malloc(cdir_size + count + 1);
+	if (zip->entries == NULL || zip->names == NULL) {
+		free(cdir);
+		return -1;
+	}
+
+	u32 pos = 0;
+	int names_pos = 0;
+	for (int i = 0; i < count; i++) {
+		if (pos + ZIP_CDIR_ENTRY_SIZE > cdir_size || ZIP_READ32(cdir, pos) != 0x02014B50) break;
+		int flags = ZIP_READ16(cdir, pos + 8);
+		int method = ZIP_READ16(cdir, pos + 10);
+		int name_len = ZIP_READ16(cdir, pos + 28);
+		int entry_len = ZIP_CDIR_ENTRY_SIZE + name_len + ZIP_READ16(cdir, pos + 30) + ZIP_READ16(cdir, pos + 32);
+		if (pos + entry_len > cdir_size) break;
+
+		zip_entry *e = &zip->entries[zip->entry_count];
+		e->crc = ZIP_READ32(cdir, pos + 16);
+		e->comp_size = ZIP_READ32(cdir, pos + 20);
+		e->size = ZIP_READ32(cdir, pos + 24);
+		e->offset = ZIP_READ32(cdir, pos + 42);
+		e->dos_time = ZIP_READ32(cdir, pos + 12);
+		e->method = method;
+
+		// skip directories, encrypted members, unsupported methods and ZIP64
+		if (name_len > 0 && cdir[pos + ZIP_CDIR_ENTRY_SIZE + name_len - 1] != '/'
+			&& (flags & 1) == 0 && (method == 0 || method == 8)
+			&& e->size < 0x7FFFFFFF && e->comp_size != 0xFFFFFFFF)
+		{
+			e->name = zip->names + names_pos;
+			memcpy(e->name, cdir + pos + ZIP_CDIR_ENTRY_SIZE, name_len);
+			e->name[name_len] = 0;
+			names_pos += name_len + 1;
+			e->hash = vfs_name_hash(e->name);
+			e->has_digest = 0;
+			e->data = NULL;
+			e->refs = 0;
+			zip->entry_count++;
+		}
+		pos += entry_len;
+	}
+	free(cdir);
+
+	// the table is kept at most half full
+	int table_size = 16;
+	while (table_size < zip->entry_count * 2) table_size *= 2;
+	zip->table = calloc(table_size, sizeof(int));
+	zip->cached = malloc(sizeof(int) * (zip->entry_count > 0 ? zip->entry_count : 1));
+	if (zip->table == NULL || zip->cached == NULL) return -1;
+	zip->table_mask = table_size - 1;
+
+	for (int i = 0; i < zip->entry_count; i++) {
+		int tpos = zip->entries[i].hash & zip->table_mask;
+		while (zip->table[tpos] != 0) tpos = (tpos + 1) & zip->table_mask;
+		zip->table[tpos] = i + 1;
+	}
+	return 0;
+}
+
+zip_archive *zip_archive_open(const char *filename) {
+	zip_archive *zip = calloc(1, sizeof(zip_archive));
+	if (zip == NULL) return NULL;
+
+	zip->cache_limit = ZIP_CACHE_DEFAULT_LIMIT;
+	zip->file = fopen(filename, "rb");
+	if (zip->file == NULL || zip_read_directory(zip) < 0) {
+		zip_archive_close(zip);
+		return NULL;
+	}
+	return zip;
+}
+
+void zip_archive_close(zip_archive *zip) {
+	for (int i = 0; i < zip->cached_count; i++) {
+		free(zip->entries[zip->cached[i]].data);
+	}
+	if (zip->file != NULL) fclose(zip->file);
+	free(zip->cached);
+	free(zip->table);
+	free(zip->entries);
+	free(zip->names);
+	free(zip);
+}
+
+int zip_entry_count(zip_archive *zip) {
+	return zip->entry_count;
+}
+
+const char *zip_entry_name(zip_archive *zip, int id) {
+	return zip->entries[id].name;
+}
+
+int zip_entry_find(zip_archive *zip, const char *name) {
+	u32 hash = vfs_name_hash(name);
+	int pos = hash & zip->table_mask;
+
+	while (zip->table[pos] != 0) {
+		zip_entry *e = &zip->entries[zip->table[pos] - 1];
+		if (e->hash == hash && strcasecmp(e->name, name) == 0) return zip->table[pos] - 1;
+		pos = (pos + 1) & zip->table_mask;
+	}
+	return -1;
+}
+
+// drops the least recently used entries not in use, until under the limit
+static void zip_cache_trim(zip_archive *zip) {
+	while (zip->cached_bytes > zip->cache_limit) {
+		int oldest = -1;
+		for (int i = 0; i < zip->cached_count; i++) {
+			zip_entry *e = &zip->entries[zip->cached[i]];
+			if (e->refs == 0 && (oldest < 0 || e->last_use < zip->entries[zip->cached[oldest]].last_use)) {
+				oldest = i;
+			}
+		}
+		if (oldest < 0) return;
+
+		zip_entry *e = &zip->entries[zip->cached[oldest]];
+		zip->cached_bytes -= e->size;
+		free(e->data);
+		e->data = NULL;
+		zip->cached[oldest] = zip->cached[--zip->cached_count];
+	}
+}
+
+void zip_archive_set_cache_limit(zip_archive *zip, long bytes) {
+	zip->cache_limit = bytes;
+	zip_cache_trim(zip);
+}
+
+// where the packed data starts, past the local header; -1 on error
+static long zip_entry_data_pos(zip_archive *zip, zip_entry *e) {
+	u8 header[ZIP_LOCAL_HEADER_SIZE];
+
+	if (zip_read_at(zip->file, e->offset, header, ZIP_LOCAL_HEADER_SIZE) < 0 || ZIP_READ32(header, 0) != 0x04034B50) {
+		return -1;
+	}
+	return e->offset + ZIP_LOCAL_HEADER_SIZE + ZIP_READ16(header, 26) + ZIP_READ16(header, 28);
+}
+
+static int zip_entry_inflate(zip_archive *zip, zip_entry *e, u8 *data) {
+	u8 chunk[ZIP_INFLATE_CHUNK];
+	z_stream stream;
+	int result = -1;
+
+	long pos = zip_entry_data_pos(zip, e);
+	if (pos < 0) return -1;
+
+	if (e->method == 0) {
+		if (e->comp_size != e->size || (e->size > 0 && zip_read_at(zip->file, pos, data, e->size) < 0)) return -1;
+	} else {
+		// streamed from the file, a chunk at a time
+		memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) return -1;
+		stream.next_out = data;
+		stream.avail_out = e->size;
+
+		u32 remaining = e->comp_size;
+		int zresult = Z_OK;
+		if (fseek(zip->file, pos, SEEK_SET) == 0) {
+			while (zresult == Z_OK && remaining > 0) {
+				int len = remaining < ZIP_INFLATE_CHUNK ? (int) remaining : ZIP_INFLATE_CHUNK;
+				if (fread(chunk, 1, len, zip->file) != (size_t) len) break;
+				remaining -= len;
+				stream.next_in = chunk;
+				stream.avail_in = len;
+				zresult = inflate(&stream, Z_NO_FLUSH);
+			}
+		}
+		if (zresult == Z_STREAM_END && stream.total_out == e->size) result = 0;
+		inflateEnd(&stream);
+		if (result < 0) return -1;
+	}
+
+	return crc32(0, data, e->size) == e->crc ? 0 : -1;
+}
+
+int zip_entry_size(zip_archive *zip, int id) {
+	return zip->entries[id].size;
+}
+
+u32 zip_entry_dos_time(zip_archive *zip, int id) {
+	return zip->entries[id].dos_time;
+}
+
+u32 zip_entry_crc(zip_archive *zip, int id) {
+	return zip->entries[id].crc;
+}
+
+int zip_entry_digest(zip_archive *zip, int id, u8 *digest) {
+	zip_entry *e = &zip->entries[id];
+
+	if (!e->has_digest) {
+		// the method, size and CRC-32 ahead of the packed data
+		u8 *buffer = malloc(12 + (long) e->comp_size);
+		if (buffer == NULL) return -1;
+		for (int i = 0; i < 4; i++) {
+			buffer[i] = (e->method >> (i * 8)) & 0xFF;
+			buffer[4 + i] = (e->size >> (i * 8)) & 0xFF;
+			buffer[8 + i] = (e->crc >> (i * 8)) & 0xFF;
+		}
+		long pos = zip_entry_data_pos(zip, e);
+		if (pos < 0 || (e->comp_size > 0 && zip_read_at(zip->file, pos, buffer + 12, e->comp_size) < 0)) {
+			free(buffer);
+			return -1;
+		}
+		vfs_sha256(buffer, 12 + (long) e->comp_size, e->digest);
+		e->has_digest = 1;
+		free(buffer);
+	}
+	memcpy(digest, e->digest, VFS_SHA256_SIZE);
+	return 0;
+}
+
+int zip_entry_unpack(zip_archive *zip, int id, u8 *data) {
+	zip_entry *e = &zip->entries[id];
+
+	if (e->data != NULL) {
+		memcpy(data, e->data, e->size);
+		return 0;
+	}
+	if (zip_entry_inflate(zip, e, data) < 0) {
+		fprintf(stderr, "could not unpack %s\n", e->name);
+		return -1;
+	}
+	return 0;
+}
+
+const u8 *zip_entry_acquire(zip_archive *zip, int id, int *len) {
+	zip_entry *e = &zip->entries[id];
+
+	if (e->data == NULL) {
+		u8 *data = malloc(e->size > 0 ? e->size : 1);
+		if (data == NULL) return NULL;
+		if (zip_entry_inflate(zip, e, data) < 0) {
+			fprintf(stderr, "could not unpack %s\n", e->name);
+			free(data);
+			return NULL;
+		}
+		e->data = data;
+		zip->cached[zip->cached_count++] = id;
+		zip->cached_bytes += e->size;
+	}
+
+	e->refs++;
+	e->last_use = ++zip->use_counter;
+	*len = e->size;
+	// trimmed after pinning, so that this entry stays
+	zip_cache_trim(zip);
+	return e->data;
+}
+
+void zip_entry_release(zip_archive *zip, int id) {
+	zip_entry *e = &zip->entries[id];
+	if (e->refs > 0 && --e->refs == 0) {
+		zip_cache_trim(zip);
+	}
+}
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2018, 2019, 2020 Adrian Siekierka
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __ZIP_VFS_H__
+#define __ZIP_VFS_H__
+
+#include "types.h"
+
+// read-only ZIP archive access: the central directory is read once on
+// open, and members are inflated when first acquired, then kept in a
+// cache of least recently used members up to a limit in bytes
+#define ZIP_CACHE_DEFAULT_LIMIT (16L << 20)
+
+typedef struct zip_archive zip_archive;
+
+zip_archive *zip_archive_open(const char *filename);
+void zip_archive_close(zip_archive *zip);
+void zip_archive_set_cache_limit(zip_archive *zip, long bytes);
+
+int zip_entry_count(zip_archive *zip);
+const char *zip_entry_name(zip_archive *zip, int id);
+// case-insensitive; returns an entry ID, or -1 if not found
+int zip_entry_find(zip_archive *zip, const char *name);
+
+int zip_entry_size(zip_archive *zip, int id);
+// modification time, DOS date in the upper word and time in the lower
+u32 zip_entry_dos_time(zip_archive *zip, int id);
+// CRC-32 of the unpacked contents, as stored
+u32 zip_entry_crc(zip_archive *zip, int id);
+// SHA-256 of how an entry is stored: its method, size, CRC-32 and packed
+// data, which together determine the contents; VFS_SHA256_SIZE bytes
+int zip_entry_digest(zip_archive *zip, int id, u8 *digest);
+// unpacks an entry into data, zip_entry_size() bytes, bypassing the cache
+int zip_entry_unpack(zip_archive *zip, int id, u8 *data);
+
+// the contents of an entry, valid until released; NULL on error
+const u8 *zip_entry_acquire(zip_archive *zip, int id, int *len);
+void zip_entry_release(zip_archive *zip, int id);
+
+#endif /* __ZIP_VFS_H__ */
@@ -22,7 +22,13 @@
 
 #include <string.h>
 #include "zzt.h"
+#include "rle.h"
 
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include "logging.h"
 
 #if defined(ANDROID) || defined(HAS_OSK)
@@ -65,13 +71,24 @@ typedef struct {
 	double timer_time;
 
 	// video
+	int video_mode;
 	int chr_width, chr_height;
 
 	// keyboard
 	int key_delay, key_repeat_delay;
 	zzt_key_entry key;
-	zzt_keybuf_entry keybuf[KEYBUF_SIZE];
+	// ring of pending keystrokes; entries whose scancode has a cull
+	// count left are skipped when read
+	zzt_keybuf_entry *keybuf;
+	int keybuf_size, keybuf_first, keybuf_count;
+	u16 keybuf_pending[256];
+	u16 keybuf_cull[256];
+	zzt_keybuf_stats keybuf_stats;
 	int kmod;
+	// ZZT calls INT 16h AH=01 once a "frame"; see cpu_func_intr_0x16
+	long kbd_call_time;
+	int kbd_call_count;
+	int kbd_idle_count;
 
 	// joystick
 	u8 joy_xstrobe_val, joy_ystrobe_val;
@@ -96,6 +113,13 @@ typedef struct {
 	u8 charset[256*16];
 	u32 palette[16];
 
+	// text memory as of the last zzt_vram_get_dirty call
+	u8 vram_shadow[80*25*2];
+
+	// set while running ahead; no audio or rewind captures. File I/O
+	// cannot be undone, so running ahead stops short of it
+	int speculative;
+	int speculation_stopped;
 } zzt_state;
 
 zzt_state zzt;
@@ -104,6 +128,85 @@ static int zzt_memory_seg_limit() {
 	return (zzt.cpu.ram[0x413] | (zzt.cpu.ram[0x414] << 8)) << 6;
 }
 
+// diagnostic log
+//
+// Written by the emulation thread, drained by the frontend. Messages go
+// through a single-producer, single-consumer ring, so neither side ever
+// blocks; each key is logged at its 1st, 2nd, 4th, 8th... occurrence.
+
+#define ZZT_LOG_RING_SIZE 64 /* power of two */
+#define ZZT_LOG_MESSAGE_SIZE 96
+#define ZZT_LOG_COUNTERS_SIZE 256 /* power of two */
+
+static char zzt_log_ring[ZZT_LOG_RING_SIZE][ZZT_LOG_MESSAGE_SIZE];
+static atomic_uint zzt_log_head, zzt_log_tail;
+static zzt_log_counter zzt_log_counters[ZZT_LOG_COUNTERS_SIZE];
+static u32 zzt_log_dropped;
+
+void zzt_log(int type, int id, const char *fmt, ...) {
+	u32 key = (type << 16) | (id & 0xFFFF);
+	u32 i = (key * 0x9E3779B1U) >> 24;
+	zzt_log_counter *counter;
+	va_list args;
+
+	if (zzt.speculative) return;
+
+	// open addressing; count into the last slot when full
+	for (int probe = 0; ; probe++, i = (i + 1) & (ZZT_LOG_COUNTERS_SIZE - 1)) {
+		counter = &zzt_log_counters[i];
+		if (counter->count == 0) {
+			counter->type = type;
+			counter->id = id;
+			break;
+		}
+		if ((counter->type == type && counter->id == id) || probe == ZZT_LOG_COUNTERS_SIZE - 1) break;
+	}
+
+	u32 count = ++counter->count;
+	if ((count & (count - 1)) != 0) return;
+
+	u32 head = atomic_load_explicit(&zzt_log_head, memory_order_relaxed);
+	u32 tail = atomic_load_explicit(&zzt_log_tail, memory_order_acquire);
+	if ((head - tail) >= ZZT_LOG_RING_SIZE) {
+		zzt_log_dropped++;
+		return;
+	}
+
+	char *msg = zzt_log_ring[head & (ZZT_LOG_RING_SIZE - 1)];
+	va_start(args, fmt);
+	int len = vsnprintf(msg, ZZT_LOG_MESSAGE_SIZE, fmt, args);
+	va_end(args);
+	if (count > 1 && len >= 0 && len < ZZT_LOG_MESSAGE_SIZE) {
+		snprintf(msg + len, ZZT_LOG_MESSAGE_SIZE - len, " (x%u)", count);
+	}
+	atomic_store_explicit(&zzt_log_head, head + 1, memory_order_release);
+}
+
+int zzt_log_drain(char *buf, int len) {
+	u32 tail = atomic_load_explicit(&zzt_log_tail, memory_order_relaxed);
+	u32 head = atomic_load_explicit(&zzt_log_head, memory_order_acquire);
+
+	if (head == tail) return 0;
+	snprintf(buf, len, "%s", zzt_log_ring[tail & (ZZT_LOG_RING_SIZE - 1)]);
+	atomic_store_explicit(&zzt_log_tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+int zzt_log_get_counters(zzt_log_counter *counters, int max) {
+	int count = 0;
+
+	for (int i = 0; i < ZZT_LOG_COUNTERS_SIZE && count < max; i++) {
+		if (zzt_log_counters[i].count > 0) {
+			counters[count++] = zzt_log_counters[i];
+		}
+	}
+	return count;
+}
+
+u32 zzt_log_dropped_count(void) {
+	return zzt_log_dropped;
+}
+
 void zzt_kmod_set(int mod) {
 	zzt.kmod |= mod;
 }
@@ -116,21 +219,95 @@ static long zzt_internal_time(void) {
 	return zzt.timer_time_offset + ((long) zzt.timer_time);
 }
 
+static void zzt_keybuf_clear(void) {
+	zzt.keybuf_first = 0;
+	zzt.keybuf_count = 0;
+	memset(zzt.keybuf_pending, 0, sizeof(zzt.keybuf_pending));
+	memset(zzt.keybuf_cull, 0, sizeof(zzt.keybuf_cull));
+}
+
 static int zzt_key_append(int qch, int qke) {
-	for (int j = 0; j < KEYBUF_SIZE; j++) {
-		if (zzt.keybuf[j].qke == -1 || zzt.keybuf[j].qke == qke) {
+	if (zzt.keybuf_count >= zzt.keybuf_size) {
+		// counted in keybuf_stats; printing here would stall the
+		// emulator on every key of a held-down repeat
 #ifdef DEBUG_KEYSTROKES
-			fprintf(stderr, "key appended %d @ %d\n", qke, j);
+		fprintf(stderr, "key not appended %d\n", qke);
 #endif
-			zzt.keybuf[j].qch = qch;
-			zzt.keybuf[j].qke = qke;
-			return 1;
-		}
+		zzt.keybuf_stats.dropped++;
+		return 0;
+	}
+
+#ifdef DEBUG_KEYSTROKES
+	fprintf(stderr, "key appended %d @ %d\n", qke, zzt.keybuf_count);
+#endif
+	zzt_keybuf_entry *entry = &zzt.keybuf[(zzt.keybuf_first + zzt.keybuf_count) % zzt.keybuf_size];
+	entry->qch = qch;
+	entry->qke = qke;
+	zzt.keybuf_count++;
+	zzt.keybuf_pending[qke & 0xFF]++;
+	zzt.keybuf_stats.appended++;
+	return 1;
+}
+
+static void zzt_keybuf_drop_first(void) {
+	int qke = zzt.keybuf[zzt.keybuf_first].qke & 0xFF;
+
+	zzt.keybuf_pending[qke]--;
+	zzt.keybuf_first = (zzt.keybuf_first + 1) % zzt.keybuf_size;
+	zzt.keybuf_count--;
+}
+
+// returns the first pending keystroke which has not been culled
+static zzt_keybuf_entry *zzt_keybuf_peek(void) {
+	while (zzt.keybuf_count > 0) {
+		zzt_keybuf_entry *entry = &zzt.keybuf[zzt.keybuf_first];
+		int qke = entry->qke & 0xFF;
+		if (zzt.keybuf_cull[qke] == 0) return entry;
+
+		zzt.keybuf_cull[qke]--;
+		zzt.keybuf_stats.culled++;
+		zzt_keybuf_drop_first();
+	}
+	return NULL;
+}
+
+int zzt_key_set_buffer_size(int size) {
+	zzt_keybuf_entry *keybuf;
+	int count = 0;
+
+	if (size < 1 || size > ZZT_KEYBUF_MAX_SIZE) return -1;
+	if (size == zzt.keybuf_size) return 0;
+
+	keybuf = malloc(size * sizeof(zzt_keybuf_entry));
+	if (keybuf == NULL) return -1;
+
+	// keep the pending keystrokes which fit, oldest first
+	zzt_keybuf_entry *entry;
+	while ((entry = zzt_keybuf_peek()) != NULL) {
+		if (count < size) keybuf[count++] = *entry;
+		else zzt.keybuf_stats.dropped++;
+		zzt_keybuf_drop_first();
+	}
+
+	free(zzt.keybuf);
+	zzt.keybuf = keybuf;
+	zzt.keybuf_size = size;
+	zzt_keybuf_clear();
+	for (int i = 0; i < count; i++) {
+		zzt.keybuf_pending[keybuf[i].qke & 0xFF]++;
 	}
-	fprintf(stderr, "key not appended %d\n", qke);
+	zzt.keybuf_count = count;
 	return 0;
 }
 
+int zzt_key_get_buffer_size(void) {
+	return zzt.keybuf_size;
+}
+
+void zzt_key_get_stats(zzt_keybuf_stats *stats) {
+	*stats = zzt.keybuf_stats;
+}
+
 int zzt_key_get_delay(void) {
 	return zzt.key_delay;
 }
@@ -173,15 +350,7 @@ void zzt_keyup(int k) {
 
 	if (changed) {
 		// if the key was in repeat mode, cull existing occurences to clear up the queue
-		for (int i = 0; i < KEYBUF_SIZE; i++) {
-			if (zzt.keybuf[i].qke == k) {
-				for (int j = i+1; j < KEYBUF_SIZE; j++) {
-					zzt.keybuf[j-1] = zzt.keybuf[j];
-				}
-				zzt.keybuf[KEYBUF_SIZE-1].qke = -1;
-				i--;
-			}
-		}
+		zzt.keybuf_cull[k & 0xFF] = zzt.keybuf_pending[k & 0xFF];
 	}
 }
 
@@ -249,54 +418,74 @@ void zzt_mouse_axis(int axis, int value) {
 	}
 }
 
-static u16 cpu_func_port_in_main(cpu_state* cpu, u16 addr) {
-	zzt_state* zzt = (zzt_state*) cpu;
+// port I/O - each port maps to the device registered for it
 
-	switch (addr) {
-		case 0x61:
-			return zzt->port_61;
-		case 0x201:
-			if (!zeta_has_feature(FEATURE_JOY_CONNECTED))
-				return 0xF0;
-			zzt->port_201 &= 0xF0;
-			if (zzt->joy_xstrobes > 0) {
-				zzt->joy_xstrobes--;
-				if (zzt->joy_xstrobes == 0) cpu->keep_going--;
-				zzt->port_201 |= 1;
-			}
-			if (zzt->joy_ystrobes > 0) {
-				zzt->joy_ystrobes--;
-				if (zzt->joy_ystrobes == 0) cpu->keep_going--;
-				zzt->port_201 |= 2;
-			}
-			return zzt->port_201;
-		case 0x3D4: return zzt->cga_crt_index;
-		case 0x3D5:
-			fprintf(stderr, "CRT port in %02X\n", zzt->cga_crt_index);
-			return 0;
-		case 0x3D9: return zzt->cga_palette;
-		case 0x3DA: {
-			int old_status = zzt->cga_status;
-			zzt->cga_status = (old_status & (~0x8)) ^ 0x1;
-			return old_status;
-		}
-		default:
-			fprintf(stderr, "port in %04X\n", addr);
-			return 0;
+typedef u16 (*zzt_port_in_func)(zzt_state* zzt, u16 port);
+typedef void (*zzt_port_out_func)(zzt_state* zzt, u16 port, u16 val);
+
+typedef struct {
+	zzt_port_in_func in;
+	zzt_port_out_func out;
+} zzt_port_device;
+
+#define ZZT_PORT_DEVICES_MAX 16
+
+// device 0 is "unhandled"
+static zzt_port_device zzt_port_devices[ZZT_PORT_DEVICES_MAX];
+static int zzt_port_device_count;
+static u8 zzt_port_map_in[65536];
+static u8 zzt_port_map_out[65536];
+
+static void zzt_port_register(const u16 *ports, int count, zzt_port_in_func in, zzt_port_out_func out) {
+	if (zzt_port_device_count >= ZZT_PORT_DEVICES_MAX) return;
+
+	int id = zzt_port_device_count++;
+	zzt_port_devices[id].in = in;
+	zzt_port_devices[id].out = out;
+	for (int i = 0; i < count; i++) {
+		if (in != NULL) zzt_port_map_in[ports[i]] = id;
+		if (out != NULL) zzt_port_map_out[ports[i]] = id;
 	}
 }
 
-static void cpu_func_port_out_main(cpu_state* cpu, u16 addr, u16 val) {
-	zzt_state* zzt = (zzt_state*) cpu;
+static int zzt_speed = 1;
+static int zzt_speed_audio = ZZT_SPEED_AUDIO_KEEP;
+
+static int zzt_audio_enabled(zzt_state* zzt) {
+	if (zzt->speculative) return 0;
+	if (zzt_speed == ZZT_SPEED_UNLIMITED) return 0;
+	return zzt_speed == 1 || zzt_speed_audio != ZZT_SPEED_AUDIO_MUTE;
+}
+
+int zzt_set_speed(int speed, int audio_mode) {
+	if (speed < 0 || speed > ZZT_SPEED_MAX || (speed & (speed - 1)) != 0) return -1;
+
+	int was_enabled = zzt_audio_enabled(&zzt);
+	zzt_speed = speed;
+	zzt_speed_audio = audio_mode;
+	int enabled = zzt_audio_enabled(&zzt);
+
+	if (was_enabled && !enabled) {
+		speaker_off(zzt.cpu.cycles);
+	} else if (!was_enabled && enabled && !zzt.port_42_latch && (zzt.port_61 & 3) == 3) {
+		speaker_on(zzt.cpu.cycles, 1193182.0 / zzt.port_42);
+	}
+	return 0;
+}
+
+int zzt_get_speed(void) {
+	return zzt_speed;
+}
 
-	switch (addr) {
+static void zzt_pit_out(zzt_state* zzt, u16 port, u16 val) {
+	switch (port) {
 		case 0x42:
 			if (zzt->port_42_latch) zzt->port_42 = (zzt->port_42 & 0xFF) | ((val << 8) & 0xFF00);
 			else zzt->port_42 = (zzt->port_42 & 0xFF00) | (val & 0xFF);
 			zzt->port_42_latch ^= 1;
 //			if (!port_42_latch && (port_43[2] & 0x04) == 0x04 && (port_61 & 3) == 3) {
-			if (!(zzt->port_42_latch) && (zzt->port_61 & 3) == 3) {
-				speaker_on(cpu->cycles, 1193182.0 / zzt->port_42);
+			if (!(zzt->port_42_latch) && (zzt->port_61 & 3) == 3 && zzt_audio_enabled(zzt)) {
+				speaker_on(zzt->cpu.cycles, 1193182.0 / zzt->port_42);
 			}
 			return;
 		case 0x43: {
@@ -306,15 +495,58 @@ static void cpu_func_port_out_main(cpu_state* cpu, u16 addr, u16 val) {
 				zzt->port_43[addr] = val;
 			} */
 		} return;
-		case 0x61:
-			zzt->port_61 = val;
-			if ((val & 3) != 3) {
-				speaker_off(cpu->cycles);
-			}
-			return;
-		case 0x201:
-			zzt_joy_strobe(zzt);
-			return;
+	}
+}
+
+static u16 zzt_ppi_in(zzt_state* zzt, u16 port) {
+	return zzt->port_61;
+}
+
+static void zzt_ppi_out(zzt_state* zzt, u16 port, u16 val) {
+	zzt->port_61 = val;
+	if ((val & 3) != 3 && zzt_audio_enabled(zzt)) {
+		speaker_off(zzt->cpu.cycles);
+	}
+}
+
+static u16 zzt_joy_in(zzt_state* zzt, u16 port) {
+	if (!zeta_has_feature(FEATURE_JOY_CONNECTED))
+		return 0xF0;
+	zzt->port_201 &= 0xF0;
+	if (zzt->joy_xstrobes > 0) {
+		zzt->joy_xstrobes--;
+		if (zzt->joy_xstrobes == 0) zzt->cpu.keep_going--;
+		zzt->port_201 |= 1;
+	}
+	if (zzt->joy_ystrobes > 0) {
+		zzt->joy_ystrobes--;
+		if (zzt->joy_ystrobes == 0) zzt->cpu.keep_going--;
+		zzt->port_201 |= 2;
+	}
+	return zzt->port_201;
+}
+
+static void zzt_joy_out(zzt_state* zzt, u16 port, u16 val) {
+	zzt_joy_strobe(zzt);
+}
+
+static u16 zzt_cga_in(zzt_state* zzt, u16 port) {
+	switch (port) {
+		case 0x3D4: return zzt->cga_crt_index;
+		case 0x3D5:
+			zzt_log(ZZT_LOG_CRT_IN, zzt->cga_crt_index, "CRT port in %02X", zzt->cga_crt_index);
+			return 0;
+		case 0x3D9: return zzt->cga_palette;
+		case 0x3DA: default: {
+			int old_status = zzt->cga_status;
+			zzt->cga_status = (old_status & (~0x8)) ^ 0x1;
+			return old_status;
+		}
+	}
+}
+
+static void zzt_cga_out(zzt_state* zzt, u16 port, u16 val) {
+	switch (port) {
 		case 0x3D4: zzt->cga_crt_index = val; return;
 		case 0x3D5:
 			switch (zzt->cga_crt_index) {
@@ -323,15 +555,51 @@ static void cpu_func_port_out_main(cpu_state* cpu, u16 addr, u16 val) {
 					// we do not render the cursor, so we do not need those values
 					break;
 				default:
-					fprintf(stderr, "CRT port out %02X = %02X\n", zzt->cga_crt_index, val);
+					zzt_log(ZZT_LOG_CRT_OUT, zzt->cga_crt_index, "CRT port out %02X = %02X", zzt->cga_crt_index, val);
 			}
 			return;
 		case 0x3D9: zzt->cga_palette = val; return;
-		default:
-			fprintf(stderr, "port out %04X = %04X\n", addr, val);
 	}
 }
 
+static void zzt_port_init(void) {
+	static const u16 pit_ports[] = {0x42, 0x43};
+	static const u16 ppi_ports[] = {0x61};
+	static const u16 joy_ports[] = {0x201};
+	static const u16 cga_ports[] = {0x3D4, 0x3D5, 0x3D9};
+	static const u16 cga_status_ports[] = {0x3DA};
+
+	memset(zzt_port_map_in, 0, sizeof(zzt_port_map_in));
+	memset(zzt_port_map_out, 0, sizeof(zzt_port_map_out));
+	zzt_port_device_count = 1;
+
+	zzt_port_register(pit_ports, 2, NULL, zzt_pit_out);
+	zzt_port_register(ppi_ports, 1, zzt_ppi_in, zzt_ppi_out);
+	zzt_port_register(joy_ports, 1, zzt_joy_in, zzt_joy_out);
+	zzt_port_register(cga_ports, 3, zzt_cga_in, zzt_cga_out);
+	zzt_port_register(cga_status_ports, 1, zzt_cga_in, NULL);
+}
+
+static u16 cpu_func_port_in_main(cpu_state* cpu, u16 addr) {
+	int id = zzt_port_map_in[addr];
+
+	if (id == 0) {
+		zzt_log(ZZT_LOG_PORT_IN, addr, "port in %04X", addr);
+		return 0;
+	}
+	return zzt_port_devices[id].in((zzt_state*) cpu, addr);
+}
+
+static void cpu_func_port_out_main(cpu_state* cpu, u16 addr, u16 val) {
+	int id = zzt_port_map_out[addr];
+
+	if (id == 0) {
+		zzt_log(ZZT_LOG_PORT_OUT, addr, "port out %04X = %04X", addr, val);
+		return;
+	}
+	zzt_port_devices[id].out((zzt_state*) cpu, addr, val);
+}
+
 static void cpu_func_intr_0x33(cpu_state* cpu) {
 	zzt_state* zzt = (zzt_state*) cpu;
 
@@ -354,7 +622,7 @@ static void cpu_func_intr_0x33(cpu_state* cpu) {
 			zzt->mouse_yd = 0;
 			break;
 		default:
-			fprintf(stderr, "mouse %04X\n", cpu->ax);
+			zzt_log(ZZT_LOG_INTERRUPT, 0x3300 | cpu->al, "mouse %04X", cpu->ax);
 			break;
 	}
 }
@@ -363,6 +631,14 @@ void zzt_set_timer_offset(long time) {
 	zzt.timer_time_offset = time;
 }
 
+#define ZZT_HLE_VECTOR 0xF1
+static int zzt_hle_trap(cpu_state* cpu);
+static void zzt_hle_scan(u32 addr, int len);
+static void zzt_hle_check_cancel(void);
+static void zzt_observe_file_opened(int handle, const char *filename);
+static void zzt_observe_file_closing(int handle);
+static void zzt_observe_file_read(int handle, u32 addr, int len);
+
 static int cpu_func_interrupt_main(cpu_state* cpu, u8 intr) {
 #ifdef DEBUG_INTERRUPTS
 	fprintf(stderr, "dbg: interrupt %02X %04X\n", intr, cpu->ax);
@@ -384,6 +660,7 @@ static int cpu_func_interrupt_main(cpu_state* cpu, u8 intr) {
 			cpu->ram[0x46d] = (time>>8) & 0xFF;
 			cpu->ram[0x46e] = (time>>16) & 0xFF;
 			cpu->ram[0x46f] = (time>>24) & 0xFF;
+			cpu_mark_ram(cpu, 0x46c, 4);
 			cpu_emit_interrupt(cpu, 0x1C);
 		} break;
 		case 0x1C: break;
@@ -393,87 +670,123 @@ static int cpu_func_interrupt_main(cpu_state* cpu, u8 intr) {
 		case 0x20: return STATE_END;
 		case 0x21: return cpu_func_intr_0x21(cpu);
 		case 0x33: cpu_func_intr_0x33(cpu); break;
+		case ZZT_HLE_VECTOR: return zzt_hle_trap(cpu);
 		case 0x15:
-			fprintf(stderr, "sysconf %04X\n", cpu->ax);
+			zzt_log(ZZT_LOG_INTERRUPT, 0x1500 | cpu->ah, "sysconf %04X", cpu->ax);
 			cpu->ah = 0x86;
 			cpu->flags |= FLAG_CARRY;
 			break;
 		default:
-			fprintf(stderr, "unknown interrupt %02X %04X\n", intr, cpu->ax);
+			zzt_log(ZZT_LOG_INTERRUPT, (intr << 8) | cpu->ah, "unknown interrupt %02X %04X", intr, cpu->ax);
 			break;
 	}
 
 	return STATE_CONTINUE;
 }
 
-static void video_scroll_up(cpu_state* cpu, int lines, u8 empty_attr, int y1, int x1, int y2, int x2) {
-	if (lines <= 0) {
-		for (int y = y1; y <= y2; y++)
-		for (int x = x1; x <= x2; x++) {
-			cpu->ram[TEXT_ADDR(x,y)] = 0;
-			cpu->ram[TEXT_ADDR(x,y)+1] = empty_attr;
-		}
+// scroll the text window (x1, y1) - (x2, y2) by the given number of
+// lines - positive for up, negative for down, zero to clear it
+static void video_scroll(cpu_state* cpu, int lines, u8 empty_attr, int y1, int x1, int y2, int x2) {
+	u8 empty_row[160];
+
+	if (x2 > 79) x2 = 79;
+	if (y2 > 24) y2 = 24;
+	if (x1 > x2 || y1 > y2) return;
+
+	int row_len = (x2 - x1 + 1) * 2;
+	int height = y2 - y1 + 1;
+	if (lines == 0 || lines >= height || lines <= -height) lines = height;
+
+	for (int i = 0; i < row_len; i += 2) {
+		empty_row[i] = 0;
+		empty_row[i + 1] = empty_attr;
+	}
+
+	cpu_mark_ram(cpu, TEXT_ADDR(x1, y1), (height - 1) * 160 + row_len);
+	if (lines > 0) {
+		for (int y = y1; y <= y2 - lines; y++)
+			memmove(cpu->ram + TEXT_ADDR(x1, y), cpu->ram + TEXT_ADDR(x1, y + lines), row_len);
+		for (int y = y2 - lines + 1; y <= y2; y++)
+			memcpy(cpu->ram + TEXT_ADDR(x1, y), empty_row, row_len);
 	} else {
-		for (int y = y1+lines; y <= y2; y++)
-		for (int x = x1; x <= x2; x++) {
-			cpu->ram[TEXT_ADDR(x,y-lines)] = cpu->ram[TEXT_ADDR(x,y)];
-			cpu->ram[TEXT_ADDR(x,y-lines)+1] = cpu->ram[TEXT_ADDR(x,y)+1];
-		}
+		lines = -lines;
+		for (int y = y2; y >= y1 + lines; y--)
+			memmove(cpu->ram + TEXT_ADDR(x1, y), cpu->ram + TEXT_ADDR(x1, y - lines), row_len);
+		for (int y = y1; y < y1 + lines; y++)
+			memcpy(cpu->ram + TEXT_ADDR(x1, y), empty_row, row_len);
+	}
+}
 
-		for (int y = y2-lines+1; y <= y2; y++)
-		for (int x = x1; x <= x2; x++) {
-			cpu->ram[TEXT_ADDR(x,y)] = 0;
-			cpu->ram[TEXT_ADDR(x,y)+1] = empty_attr;
-		}
+static void cpu_0x10_newline(cpu_state* cpu) {
+	if (cpu->ram[0x451] < 24) {
+		cpu->ram[0x451]++;
+	} else {
+		video_scroll(cpu, 1, 0x07, 0, 0, 24, cpu->ram[0x44A] - 1);
 	}
 }
 
-static void cpu_0x10_output(cpu_state* cpu, u8 chr) {
+// teletype output of len characters; runs of printable characters are
+// written to the current row in one go
+static void cpu_0x10_output_string(cpu_state* cpu, const u8* str, int len) {
 	u8 cursor_width = cpu->ram[0x44A];
-	u8 cursor_height = 25;
 
-	switch (chr) {
-		case 0x0D:
-			cpu->ram[0x450] = 0;
-			break;
-		case 0x0A:
-			if (cpu->ram[0x451] < (cursor_height - 1)) {
-				cpu->ram[0x451]++;
-			} else {
-				video_scroll_up(cpu, 1, 0x07, 0, 0, cursor_height - 1, cursor_width - 1);
-			}
-			break;
-		case 0x08:
-			if (cpu->ram[0x450] > 0)
-				cpu->ram[0x450]--;
-			cpu->ram[TEXT_ADDR(cpu->ram[0x450], cpu->ram[0x451])] = 0;
-			break;
-		case 0x07:
-			break;
-		default:
-			cpu->ram[TEXT_ADDR(cpu->ram[0x450], cpu->ram[0x451])] = chr;
-			cpu->ram[0x450]++;
-			if (cpu->ram[0x450] >= cursor_width) {
+	cpu_mark_ram(cpu, 0x450, 2);
+
+	while (len > 0) {
+		u8 chr = *str;
+		switch (chr) {
+			case 0x0D:
 				cpu->ram[0x450] = 0;
-				if (cpu->ram[0x451] < (cursor_height - 1)) {
-					cpu->ram[0x451]++;
-				} else {
-					video_scroll_up(cpu, 1, 0x07, 0, 0, cursor_height - 1, cursor_width - 1);
+				break;
+			case 0x0A:
+				cpu_0x10_newline(cpu);
+				break;
+			case 0x08:
+				if (cpu->ram[0x450] > 0)
+					cpu->ram[0x450]--;
+				cpu->ram[TEXT_ADDR(cpu->ram[0x450], cpu->ram[0x451])] = 0;
+				cpu_mark_ram(cpu, TEXT_ADDR(cpu->ram[0x450], cpu->ram[0x451]), 1);
+				break;
+			case 0x07:
+				break;
+			default: {
+				int x = cpu->ram[0x450];
+				int run = 0;
+				u8 *dst = cpu->ram + TEXT_ADDR(x, cpu->ram[0x451]);
+				while (run < len && (run == 0 || x + run < cursor_width)) {
+					chr = str[run];
+					if (chr == 0x0D || chr == 0x0A || chr == 0x08 || chr == 0x07) break;
+					dst[run * 2] = chr;
+					run++;
 				}
-			}
-			break;
+				cpu_mark_ram(cpu, TEXT_ADDR(x, cpu->ram[0x451]), run * 2);
+				x += run;
+				str += run;
+				len -= run;
+				if (x >= cursor_width) {
+					x = 0;
+					cpu_0x10_newline(cpu);
+				}
+				cpu->ram[0x450] = x;
+			} continue;
+		}
+		str++;
+		len--;
 	}
 }
 
-static int video_mode = 3;
+static void cpu_0x10_output(cpu_state* cpu, u8 chr) {
+	cpu_0x10_output_string(cpu, &chr, 1);
+}
+
 int zzt_video_mode(void) {
-	return video_mode;
+	return zzt.video_mode;
 }
 
 static void cpu_func_intr_0x10(cpu_state* cpu) {
 	switch (cpu->ah) {
 		case 0x00: // set video mode
-			video_mode = cpu->al & 0x7F;
+			zzt.video_mode = cpu->al & 0x7F;
 			return;
 		case 0x01: // cursor shape
 			// fprintf(stderr, "int 0x10 set cursor shape %04X\n", cpu->cx);
@@ -481,6 +794,7 @@ static void cpu_func_intr_0x10(cpu_state* cpu) {
 		case 0x02:
 			cpu->ram[0x451] = cpu->dh;
 			cpu->ram[0x450] = cpu->dl;
+			cpu_mark_ram(cpu, 0x450, 2);
 			return;
 		case 0x03:
 			cpu->dh = cpu->ram[0x451];
@@ -494,20 +808,33 @@ static void cpu_func_intr_0x10(cpu_state* cpu) {
 			// In general, we only support zero. So ignore.
 			return;
 		case 0x06: // scroll up
-			video_scroll_up(cpu, cpu->al, cpu->bh, cpu->ch, cpu->cl, cpu->dh, cpu->dl);
+			video_scroll(cpu, cpu->al, cpu->bh, cpu->ch, cpu->cl, cpu->dh, cpu->dl);
 			return;
-		case 0x08: {
-			u32 addr = TEXT_ADDR(cpu->bl, cpu->bh);
-			cpu->ah = 0x08;
+		case 0x07: // scroll down
+			video_scroll(cpu, -cpu->al, cpu->bh, cpu->ch, cpu->cl, cpu->dh, cpu->dl);
+			return;
+		case 0x08: { // read character at cursor
+			u32 addr = TEXT_ADDR(cpu->ram[0x450], cpu->ram[0x451]);
 			cpu->al = cpu->ram[addr];
-			cpu->bh = cpu->ram[addr+1];
+			cpu->ah = cpu->ram[addr+1];
 		} return;
-		case 0x09:
+		case 0x09: // write character (and attribute) at cursor
 		case 0x0A: {
-			u32 addr = TEXT_ADDR(cpu->bl, cpu->bh);
-			for (int i = 0; i < cpu->cx && addr < 160*25; i++, addr+=2) {
-				cpu->ram[addr] = cpu->al;
-				if (cpu->ah == 0x09) cpu->ram[addr + 1] = cpu->bl;
+			u32 addr = TEXT_ADDR(cpu->ram[0x450], cpu->ram[0x451]);
+			if (addr >= TEXT_ADDR(0, 25)) return;
+			s32 room = ((s32) TEXT_ADDR(0, 25) - (s32) addr) / 2;
+			s32 count = cpu->cx;
+			if (count > room) count = room;
+			cpu_mark_ram(cpu, addr, count * 2);
+			if (cpu->ah == 0x09) {
+				u16 cell = cpu->al | (cpu->bl << 8);
+				for (s32 i = 0; i < count; i++, addr += 2) {
+					cpu->ram[addr] = cell & 0xFF;
+					cpu->ram[addr + 1] = cell >> 8;
+				}
+			} else {
+				for (s32 i = 0; i < count; i++, addr += 2)
+					cpu->ram[addr] = cpu->al;
 			}
 		} return;
 		case 0x0E:
@@ -515,7 +842,7 @@ static void cpu_func_intr_0x10(cpu_state* cpu) {
 			return;
 		case 0x0F: // query
 			cpu->ah = cpu->ram[0x44A];
-			cpu->al = video_mode;
+			cpu->al = zzt.video_mode;
 			cpu->bh = 0; // active page
 			return;
 		case 0x11:
@@ -559,51 +886,47 @@ static void cpu_func_intr_0x10(cpu_state* cpu) {
 			break;
 	}
 
-	fprintf(stderr, "int 0x10 AX=%04X AH=%02X AL=%02X BL=%02X\n",
+	zzt_log(ZZT_LOG_INTERRUPT, 0x1000 | cpu->ah, "int 0x10 AX=%04X AH=%02X AL=%02X BL=%02X",
 		cpu->ax, cpu->ah, cpu->al, cpu->bl);
 	cpu->flags |= FLAG_CARRY;
 }
 
 static void cpu_func_intr_0x13(cpu_state* cpu) {
-	fprintf(stderr, "int 0x13 AX=%04X\n", cpu->ax);
+	zzt_log(ZZT_LOG_INTERRUPT, 0x1300 | cpu->ah, "int 0x13 AX=%04X", cpu->ax);
 }
 
-// ZZT calls this once a "frame". But let's give it a bit of a buffer,
-// in case this doesn't always hold true.
-static long kbd_call_time = 0;
-static int kbd_call_count = 0;
-
 static int cpu_func_intr_0x16(cpu_state* cpu) {
 	zzt_state* zzt = (zzt_state*) cpu;
 
 	if (cpu->ah == 0x00) {
-		if (zzt->keybuf[0].qke >= 0) {
+		zzt_keybuf_entry *entry = zzt_keybuf_peek();
+		if (entry != NULL) {
 			cpu->flags &= ~FLAG_ZERO;
-			cpu->ah = zzt->keybuf[0].qke;
-			cpu->al = zzt->keybuf[0].qch;
-
-			// rotate keybuf
-			for (int i = 1; i < KEYBUF_SIZE; i++) {
-				zzt->keybuf[i-1] = zzt->keybuf[i];
-			}
-			zzt->keybuf[KEYBUF_SIZE-1].qke = -1;
+			cpu->ah = entry->qke;
+			cpu->al = entry->qch;
+			zzt_keybuf_drop_first();
+			if (!zzt->speculative) zzt->keybuf_stats.read++;
 		} else {
 			return STATE_BLOCK;
 		}
 		return STATE_CONTINUE;
 	} else if (cpu->ah == 0x01) {
-		if (zzt->keybuf[0].qke >= 0) {
+		zzt_keybuf_entry *entry = zzt_keybuf_peek();
+		if (entry != NULL) {
 			cpu->flags &= ~FLAG_ZERO;
-			cpu->ah = zzt->keybuf[0].qke;
-			cpu->al = zzt->keybuf[0].qch;
+			cpu->ah = entry->qke;
+			cpu->al = entry->qch;
 		} else {
 			cpu->flags |= FLAG_ZERO;
-			if (kbd_call_time != zzt_internal_time()) {
-				kbd_call_time = zzt_internal_time();
-				kbd_call_count = 0;
+			// ZZT calls this once a "frame". But let's give it a bit of a buffer,
+			// in case this doesn't always hold true.
+			if (zzt->kbd_call_time != zzt_internal_time()) {
+				zzt->kbd_call_time = zzt_internal_time();
+				zzt->kbd_call_count = 0;
 			}
-			if ((++kbd_call_count) >= 4) {
-				kbd_call_count = 0;
+			if ((++zzt->kbd_call_count) >= 4) {
+				zzt->kbd_call_count = 0;
+				zzt->kbd_idle_count++;
 				return STATE_WAIT;
 			}
 		}
@@ -628,7 +951,7 @@ static int cpu_func_intr_0x16(cpu_state* cpu) {
 				zzt->key_repeat_delay = (int) (1000 / krd_tmp);
 				break;
 			default:
-				fprintf(stderr, "int 0x16:0x03 subfunction=%02X\n", cpu->al);
+				zzt_log(ZZT_LOG_INTERRUPT, 0x1603, "int 0x16:0x03 subfunction=%02X", cpu->al);
 				break;
 		}
 		return STATE_CONTINUE;
@@ -637,13 +960,22 @@ static int cpu_func_intr_0x16(cpu_state* cpu) {
 		cpu->al = 0x07;
 		return STATE_CONTINUE;
 	}
-	fprintf(stderr, "int 0x16 AX=%04X\n", cpu->ax);
+	zzt_log(ZZT_LOG_INTERRUPT, 0x1600 | cpu->ah, "int 0x16 AX=%04X", cpu->ax);
 	return STATE_CONTINUE;
 }
 
+static int zzt_dos_is_file_function(u8 ah) {
+	return (ah >= 0x3C && ah <= 0x43) || ah == 0x4E || ah == 0x4F || ah == 0x56 || ah == 0x57 || ah == 0x5A || ah == 0x5B;
+}
+
 static int cpu_func_intr_0x21(cpu_state* cpu) {
 	zzt_state* zzt = (zzt_state*) cpu;
 
+	if (zzt->speculative && zzt_dos_is_file_function(cpu->ah)) {
+		zzt->speculation_stopped = 1;
+		return STATE_BLOCK;
+	}
+
 	switch (cpu->ah) {
 		case 0x48: { // allocation (unsupported)
 			fprintf(stderr, "DOS allocation not implemented!\n");
@@ -655,10 +987,13 @@ static int cpu_func_intr_0x21(cpu_state* cpu) {
 			cpu->dl = 0x00;
 		} return STATE_CONTINUE;
 		case 0x09: { // write string (Banana Quest installer)
-			u8* ptr = cpu->ram + (cpu->seg[SEG_DS]*16 + cpu->dx);
-			while (*(ptr) != '$') {
-				cpu_0x10_output(cpu, *(ptr++));
-			}
+			u32 addr = cpu->seg[SEG_DS]*16 + cpu->dx;
+			u32 len = 65536 - cpu->dx;
+			if (addr >= 0x100000) return STATE_CONTINUE;
+			if (len > 0x100000 - addr) len = 0x100000 - addr;
+			u8* ptr = cpu->ram + addr;
+			u8* end = memchr(ptr, '$', len);
+			cpu_0x10_output_string(cpu, ptr, end != NULL ? (int) (end - ptr) : (int) len);
 			cpu->al = 0x24;
 		} return STATE_CONTINUE;
 		case 0x30: // DOS version
@@ -678,6 +1013,7 @@ static int cpu_func_intr_0x21(cpu_state* cpu) {
 			cpu->ram[cpu->al * 4 + 1] = cpu->dh;
 			cpu->ram[cpu->al * 4 + 2] = cpu->seg[SEG_DS] & 0xFF;
 			cpu->ram[cpu->al * 4 + 3] = cpu->seg[SEG_DS] >> 8;
+			cpu_mark_ram(cpu, cpu->al * 4, 4);
 			return STATE_CONTINUE;
 		case 0x2C: { // systime
 			long ms = zzt_internal_time();
@@ -720,9 +1056,11 @@ static int cpu_func_intr_0x21(cpu_state* cpu) {
 			} else {
 				cpu->ax = handle;
 				cpu->flags &= ~FLAG_CARRY;
+				zzt_observe_file_opened(handle, STR_DS_DX);
 			}
 		} return STATE_CONTINUE;
 		case 0x3E: { // close
+			zzt_observe_file_closing(cpu->bx);
 			int res = vfs_close(cpu->bx);
 			if (res < 0) {
 				cpu->ax = 0x06;
@@ -736,6 +1074,8 @@ static int cpu_func_intr_0x21(cpu_state* cpu) {
 			fprintf(stderr, "read %04X\n", cpu->cx);
 #endif
 			int res = vfs_read(cpu->bx, (u8*)STR_DS_DX, cpu->cx);
+			cpu_mark_ram(cpu, cpu->seg[SEG_DS]*16 + cpu->dx, cpu->cx);
+			zzt_observe_file_read(cpu->bx, cpu->seg[SEG_DS]*16 + cpu->dx, res);
 			if (res < 0) {
 				cpu->ax = 0x05;
 				cpu->flags |= FLAG_CARRY;
@@ -786,6 +1126,7 @@ static int cpu_func_intr_0x21(cpu_state* cpu) {
 			return STATE_END;
 		case 0x4E: { // findfirst
 			int res = vfs_findfirst(cpu->ram + zzt->dos_dta, cpu->cx, STR_DS_DX);
+			cpu_mark_ram(cpu, zzt->dos_dta, 0x2B);
 			if (res < 0) {
 				cpu->ax = 0x12;
 				cpu->flags |= FLAG_CARRY;
@@ -796,6 +1137,7 @@ static int cpu_func_intr_0x21(cpu_state* cpu) {
 		};
 		case 0x4F: { // findnext
 			int res = vfs_findnext(cpu->ram + zzt->dos_dta);
+			cpu_mark_ram(cpu, zzt->dos_dta, 0x2B);
 			if (res < 0) {
 				cpu->ax = 0x12;
 				cpu->flags |= FLAG_CARRY;
@@ -805,7 +1147,7 @@ static int cpu_func_intr_0x21(cpu_state* cpu) {
 			break;
 		};
 		default:
-			fprintf(stderr, "int 0x21 AX=%04X\n", cpu->ax);
+			zzt_log(ZZT_LOG_INTERRUPT, 0x2100 | cpu->ah, "int 0x21 AX=%04X", cpu->ax);
 			break;
 	}
 
@@ -855,19 +1197,14 @@ static int mem_free(u32 addr) {
 	return 1;
 } */
 
-static u8 vfs_read8(int handle, int pos) {
-	u8 v;
-	vfs_seek(handle, pos, VFS_SEEK_SET);
-	vfs_read(handle, &v, 1);
-	return v;
-}
+#define MZ_HEADER_SIZE 0x1C
+#define MZ_READ16(p, pos) ((p)[pos] | ((p)[(pos) + 1] << 8))
 
-static u16 vfs_read16(int handle, int pos) {
-	u8 v1, v2;
-	vfs_seek(handle, pos, VFS_SEEK_SET);
-	vfs_read(handle, &v1, 1);
-	vfs_read(handle, &v2, 1);
-	return v1 | (v2 << 8);
+static u64 zzt_hash_bytes(u64 h, const u8 *data, int len) {
+	for (int i = 0; i < len; i++) {
+		h = (h ^ data[i]) * 0x100000001B3ULL;
+	}
+	return h;
 }
 
 static void zzt_load_build_psp(int first_seg, int last_seg, const char *arg) {
@@ -889,49 +1226,85 @@ static void zzt_load_build_psp(int first_seg, int last_seg, const char *arg) {
 
 	// set default DTA value
 	zzt.dos_dta = psp + 0x80;
+	cpu_mark_ram(&(zzt.cpu), psp, 0x100);
 }
 
-static void zzt_load_exe(int handle, const char *arg) {
-	int last_page_size = vfs_read16(handle, 2);
-	int pages = vfs_read16(handle, 4);
-	int hdr_offset = vfs_read16(handle, 8);
-//	int minalloc = vfs_read16(handle, 0xA);
-//	int maxalloc = vfs_read16(handle, 0xC);
+static int zzt_load_exe(int handle, const u8 *mz, const char *arg) {
+	int last_page_size = MZ_READ16(mz, 2);
+	int pages = MZ_READ16(mz, 4);
+	int size_reloc = MZ_READ16(mz, 6);
+	int hdr_offset = MZ_READ16(mz, 8);
+	int minalloc = MZ_READ16(mz, 0xA);
+	int maxalloc = MZ_READ16(mz, 0xC);
+	int pos_reloc = MZ_READ16(mz, 0x18);
 
 	int filesize = (pages * 512) - ((last_page_size > 0) ? (512 - last_page_size) : 0) - (hdr_offset * 16);
-/*	int size_pars = (filesize + 15) / 16;
-	size_pars += 16; // PSP */
-//	int size_pars = 40400;
-//	int offset_pars = mem_alloc(size_pars, 0);
 	int offset_pars = 0x100;
-	int size_pars = zzt_memory_seg_limit() - 0x100;
+	int avail_pars = zzt_memory_seg_limit() - offset_pars;
+	int image_pars = ((filesize + 15) / 16) + 0x10; // PSP
+
+	if (filesize <= 0 || image_pars + minalloc > avail_pars) {
+		fprintf(stderr, "not enough memory for exe: need %d paragraphs, have %d\n", image_pars + minalloc, avail_pars);
+		return -1;
+	}
+
+	// maxalloc = 0 asks to be loaded high; we always load low, with all memory
+	int size_pars = avail_pars;
+	if (maxalloc > 0 && image_pars + maxalloc < size_pars) {
+		size_pars = image_pars + maxalloc;
+	}
+
+	// the header and relocation table, in one read
+	int hdr_size = hdr_offset * 16;
+	int reloc_end = pos_reloc + size_reloc * 4;
+	int buf_size = (reloc_end > hdr_size) ? reloc_end : hdr_size;
+	if (buf_size < MZ_HEADER_SIZE) buf_size = MZ_HEADER_SIZE;
+	int file_len;
+	const u8 *file = vfs_get_data(handle, &file_len);
+	u8 *hdr_copy = NULL;
+	const u8 *hdr;
+	if (file != NULL && file_len >= buf_size) {
+		hdr = file;
+	} else {
+		hdr_copy = malloc(buf_size);
+		if (hdr_copy == NULL) return -1;
+		memset(hdr_copy, 0, buf_size);
+		vfs_seek(handle, 0, VFS_SEEK_SET);
+		vfs_read(handle, hdr_copy, buf_size);
+		hdr = hdr_copy;
+	}
 
 	// location
-	zzt.cpu.seg[SEG_CS] = vfs_read16(handle, 0x16) + offset_pars + 0x10;
-	zzt.cpu.seg[SEG_SS] = vfs_read16(handle, 0xE) + offset_pars + 0x10;
+	zzt.cpu.seg[SEG_CS] = MZ_READ16(hdr, 0x16) + offset_pars + 0x10;
+	zzt.cpu.seg[SEG_SS] = MZ_READ16(hdr, 0xE) + offset_pars + 0x10;
 	zzt.cpu.seg[SEG_DS] = offset_pars;
 	zzt.cpu.seg[SEG_ES] = offset_pars;
-	zzt.cpu.ip = vfs_read16(handle, 0x14);
-	zzt.cpu.sp = vfs_read16(handle, 0x10);
+	zzt.cpu.ip = MZ_READ16(hdr, 0x14);
+	zzt.cpu.sp = MZ_READ16(hdr, 0x10);
 
 	zzt_load_build_psp(offset_pars, offset_pars + size_pars, arg);
 
 	// load file into memory
-	vfs_seek(handle, hdr_offset * 16, VFS_SEEK_SET);
-	vfs_read(handle, &(zzt.cpu.ram[(offset_pars * 16) + 256]), filesize);
+	u8 *image = &(zzt.cpu.ram[(offset_pars * 16) + 256]);
+	if (file != NULL && file_len >= hdr_size + filesize) {
+		memcpy(image, file + hdr_size, filesize);
+	} else {
+		vfs_seek(handle, hdr_size, VFS_SEEK_SET);
+		vfs_read(handle, image, filesize);
+	}
+	cpu_mark_ram(&(zzt.cpu), (offset_pars * 16) + 256, filesize);
 #ifdef DEBUG_FS_ACCESS
 	fprintf(stderr, "wrote %d bytes to %05X\n", filesize, (offset_pars * 16 + 256));
 #endif
 
 	// relocation
-	int pos_reloc = vfs_read16(handle, 0x18);
-	int size_reloc = vfs_read16(handle, 0x06);
 	if (size_reloc > 0) {
+		u32 image_end = (offset_pars * 16) + 256 + filesize;
 		for (int i = 0; i < size_reloc; i++) {
-			int offset_seg = vfs_read16(handle, pos_reloc + i*4 + 2);
-			int offset = (offset_seg + offset_pars + 16) * 16 + vfs_read16(handle, pos_reloc + i*4);
+			const u8 *entry = hdr + pos_reloc + i*4;
+			u32 offset = (MZ_READ16(entry, 2) + offset_pars + 16) * 16 + MZ_READ16(entry, 0);
+			if (offset + 1 >= image_end) continue;
 
-			// read word at offset
 			u16 word = zzt.cpu.ram[offset] | (zzt.cpu.ram[offset + 1] << 8);
 			word += (offset_pars + 16);
 			zzt.cpu.ram[offset] = (word & 0xFF);
@@ -939,13 +1312,19 @@ static void zzt_load_exe(int handle, const char *arg) {
 		}
 		fprintf(stderr, "relocated %d exe entries\n", size_reloc);
 	}
+
+	free(hdr_copy);
+	zzt_hle_scan((offset_pars * 16) + 256, filesize);
+	return 0;
 }
 
-void zzt_load_binary(int handle, const char *arg) {
-	if (vfs_read8(handle, 0) == 0x4D && vfs_read8(handle, 1) == 0x5A) {
+int zzt_load_binary(int handle, const char *arg) {
+	u8 mz[MZ_HEADER_SIZE];
+
+	vfs_seek(handle, 0, VFS_SEEK_SET);
+	if (vfs_read(handle, mz, MZ_HEADER_SIZE) == MZ_HEADER_SIZE && mz[0] == 0x4D && mz[1] == 0x5A) {
 		// MZ, is exe file
-		zzt_load_exe(handle, arg);
-		return;
+		return zzt_load_exe(handle, mz, arg);
 	}
 
 	// assume com file
@@ -963,10 +1342,13 @@ void zzt_load_binary(int handle, const char *arg) {
 	vfs_seek(handle, 0, VFS_SEEK_SET);
 	u8 *data_ptr = &(zzt.cpu.ram[(offset_pars * 16) + 256]);
 	int bytes_read = vfs_read(handle, data_ptr, 65536 - 256);
+	cpu_mark_ram(&(zzt.cpu), (offset_pars * 16) + 256, 65536 - 256);
 	fprintf(stderr, "wrote %d bytes to %d\n", bytes_read, (offset_pars * 16 + 256));
+	if (bytes_read > 0) zzt_hle_scan((offset_pars * 16) + 256, bytes_read);
+	return 0;
 }
 
-int zzt_load_charset(int width, int height, u8 *data) {
+int zzt_load_charset(int width, int height, const u8 *data) {
 	if (width != 8 || height <= 0 || height > 16) return -1;
 
 	zzt.chr_width = width;
@@ -988,6 +1370,11 @@ int zzt_load_palette(u32 *colors) {
 	return 0;
 }
 
+static void zzt_fork_reset_base(void);
+static void zzt_rewind_reset(void);
+static void zzt_hle_reset(void);
+static void zzt_observe_reset(void);
+
 void zzt_init(int memory_kbs) {
 	if (memory_kbs < 0) {
 		// theoretical ZZT maximum!
@@ -997,13 +1384,18 @@ void zzt_init(int memory_kbs) {
 	}
 
 	zzt.key.qke = -1;
-	for (int i = 0; i < KEYBUF_SIZE; i++) {
-		zzt.keybuf[i].qke = -1;
-	}
+	if (zzt.keybuf == NULL) zzt_key_set_buffer_size(KEYBUF_SIZE);
+	zzt_keybuf_clear();
+	memset(&zzt.keybuf_stats, 0, sizeof(zzt.keybuf_stats));
 
 	zzt.key_delay = 500;
 	zzt.key_repeat_delay = 100;
 
+	zzt.kbd_call_time = 0;
+	zzt.kbd_call_count = 0;
+	zzt.kbd_idle_count = 0;
+
+	zzt.video_mode = 3;
 	zzt.timer_time = 0;
 	zzt.joy_xstrobe_val = -1;
 	zzt.joy_ystrobe_val = -1;
@@ -1016,6 +1408,12 @@ void zzt_init(int memory_kbs) {
 
 	cpu_init_globals();
 	cpu_init(&(zzt.cpu));
+	zzt_port_init();
+	zzt_fork_reset_base();
+	zzt_hle_reset();
+	zzt_observe_reset();
+	zzt_rewind_reset();
+	memset(zzt.vram_shadow, 0, sizeof(zzt.vram_shadow));
 
 	// sysconf constants
 
@@ -1030,6 +1428,8 @@ void zzt_init(int memory_kbs) {
 	zzt.cpu.ram[0x44A] = 80;
 	zzt.cpu.ram[0x463] = 0xD4;
 	zzt.cpu.ram[0x464] = 0x03;
+	cpu_mark_ram(&(zzt.cpu), 0x400, 0x100);
+	cpu_mark_ram(&(zzt.cpu), 0xFFFFE, 1);
 
 	zzt.cpu.func_port_in = cpu_func_port_in_main;
 	zzt.cpu.func_port_out = cpu_func_port_out_main;
@@ -1041,6 +1441,10 @@ void zzt_init(int memory_kbs) {
 	zzt_load_palette(def_palette);
 }
 
+int zzt_kbd_idle_count(void) {
+	return zzt.kbd_idle_count;
+}
+
 int zzt_execute(int opcodes) {
 	return cpu_execute(&(zzt.cpu), opcodes);
 }
@@ -1056,24 +1460,1480 @@ static void zzt_update_keys(void) {
 			return;
 		}
 
-		if (zzt_key_append(key->qch, key->qke)) {
+		// at most one repeat of a key is kept pending
+		if (zzt.keybuf_pending[key->qke & 0xFF] > zzt.keybuf_cull[key->qke & 0xFF] || zzt_key_append(key->qch, key->qke)) {
 			key->time = dtime;
 			key->repeat = 1;
 		}
 	}
 }
 
+static void zzt_rewind_tick(void);
+
 void zzt_mark_timer(void) {
 	zzt.timer_time += SYS_TIMER_TIME;
 	zzt_update_keys();
 	cpu_emit_interrupt(&(zzt.cpu), 0x08);
+	zzt_rewind_tick();
 }
 
 void zzt_mark_timer_turbo(void) {
 	zzt.timer_time += SYS_TIMER_TIME;
 	cpu_emit_interrupt(&(zzt.cpu), 0x08);
+	zzt_rewind_tick();
 }
 
 u8* zzt_get_ram(void) {
 	return zzt.cpu.ram;
 }
+
+int zzt_vram_get_dirty(u8 *bitmap) {
+	u8 *ram_pages = zzt.cpu.ram_pages;
+	u8 *vram = zzt.cpu.ram + 0xB8000;
+	u8 *shadow = zzt.vram_shadow;
+	int count = 0;
+
+	memset(bitmap, 0, ZZT_VRAM_DIRTY_SIZE);
+
+	// only compare the pages written to since the last call
+	for (int p = (0xB8000 >> CPU_PAGE_SHIFT); p <= ((0xB8000 + 80*25*2 - 1) >> CPU_PAGE_SHIFT); p++) {
+		if (!(ram_pages[p] & CPU_PAGE_VRAM)) continue;
+		ram_pages[p] &= ~CPU_PAGE_VRAM;
+
+		int start = (p << CPU_PAGE_SHIFT) - 0xB8000;
+		int end = start + CPU_PAGE_SIZE;
+		if (end > 80*25*2) end = 80*25*2;
+
+		for (int i = start; i < end; i += 2) {
+			if (vram[i] != shadow[i] || vram[i + 1] != shadow[i + 1]) {
+				shadow[i] = vram[i];
+				shadow[i + 1] = vram[i + 1];
+				bitmap[i >> 4] |= 1 << ((i >> 1) & 7);
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+// snapshots
+
+typedef struct {
+	u8 *data;
+	int pos, len;
+} zzt_snapshot_buf;
+
+static void snap_w8(zzt_snapshot_buf *b, u8 v) {
+	if (b->pos < b->len) b->data[b->pos] = v;
+	b->pos++;
+}
+
+static void snap_w16(zzt_snapshot_buf *b, u16 v) {
+	snap_w8(b, v);
+	snap_w8(b, v >> 8);
+}
+
+static void snap_w32(zzt_snapshot_buf *b, u32 v) {
+	snap_w16(b, v);
+	snap_w16(b, v >> 16);
+}
+
+static u8 snap_r8(zzt_snapshot_buf *b) {
+	u8 v = (b->pos < b->len) ? b->data[b->pos] : 0;
+	b->pos++;
+	return v;
+}
+
+static u16 snap_r16(zzt_snapshot_buf *b) {
+	u16 v = snap_r8(b);
+	return v | (snap_r8(b) << 8);
+}
+
+static u32 snap_r32(zzt_snapshot_buf *b) {
+	u32 v = snap_r16(b);
+	return v | ((u32) snap_r16(b) << 16);
+}
+
+static void zzt_snapshot_write_state(zzt_snapshot_buf *b) {
+	cpu_state *cpu = &(zzt.cpu);
+
+	snap_w16(b, cpu->ax); snap_w16(b, cpu->cx); snap_w16(b, cpu->dx); snap_w16(b, cpu->bx);
+	snap_w16(b, cpu->sp); snap_w16(b, cpu->bp); snap_w16(b, cpu->si); snap_w16(b, cpu->di);
+	for (int i = 0; i < 4; i++) snap_w16(b, cpu->seg[i]);
+	snap_w16(b, cpu->ip);
+	snap_w16(b, cpu->flags);
+	snap_w8(b, cpu->segmod);
+	snap_w8(b, cpu->halted);
+	snap_w32(b, cpu->keep_going);
+	snap_w32(b, cpu->cycles);
+	// the state is kept fixed-length, for rewind deltas
+	snap_w16(b, cpu->intq_pos);
+	for (int i = 0; i < MAX_INTQUEUE_SIZE; i++) snap_w8(b, i < cpu->intq_pos ? cpu->intq[i] : 0);
+
+	// timer_time is stored bit-exact
+	u64 timer_bits;
+	memcpy(&timer_bits, &(zzt.timer_time), sizeof(timer_bits));
+	snap_w32(b, (u32) zzt.timer_time_offset);
+	snap_w32(b, (u32) timer_bits);
+	snap_w32(b, (u32) (timer_bits >> 32));
+
+	snap_w8(b, zzt.video_mode);
+	snap_w8(b, zzt.chr_width);
+	snap_w8(b, zzt.chr_height);
+	for (int i = 0; i < 256 * 16; i++) snap_w8(b, zzt.charset[i]);
+	for (int i = 0; i < 16; i++) snap_w32(b, zzt.palette[i]);
+
+	snap_w16(b, zzt.key_delay);
+	snap_w16(b, zzt.key_repeat_delay);
+	// pending keystrokes, oldest first, without the culled ones; padded
+	// to the buffer size to keep the length fixed
+	u16 cull[256];
+	int keybuf_count = zzt.keybuf_count;
+	memcpy(cull, zzt.keybuf_cull, sizeof(cull));
+	for (int i = 0; i < 256; i++) keybuf_count -= cull[i];
+	snap_w16(b, zzt.keybuf_size);
+	snap_w16(b, keybuf_count);
+	for (int i = 0; i < zzt.keybuf_count; i++) {
+		zzt_keybuf_entry *entry = &zzt.keybuf[(zzt.keybuf_first + i) % zzt.keybuf_size];
+		if (cull[entry->qke & 0xFF] > 0) {
+			cull[entry->qke & 0xFF]--;
+			continue;
+		}
+		snap_w8(b, entry->qch);
+		snap_w16(b, entry->qke);
+	}
+	for (int i = keybuf_count; i < zzt.keybuf_size; i++) {
+		snap_w8(b, 0);
+		snap_w16(b, 0xFFFF);
+	}
+	snap_w8(b, zzt.kmod);
+	snap_w32(b, (u32) zzt.kbd_call_time);
+	snap_w8(b, zzt.kbd_call_count);
+
+	snap_w8(b, zzt.joy_xstrobe_val); snap_w8(b, zzt.joy_ystrobe_val);
+	snap_w8(b, zzt.joy_xstrobes); snap_w8(b, zzt.joy_ystrobes);
+
+	snap_w16(b, zzt.mouse_buttons);
+	snap_w16(b, zzt.mouse_x); snap_w16(b, zzt.mouse_y);
+	snap_w16(b, zzt.mouse_xd); snap_w16(b, zzt.mouse_yd);
+
+	snap_w8(b, zzt.cga_status); snap_w8(b, zzt.cga_palette); snap_w8(b, zzt.cga_crt_index);
+	snap_w8(b, zzt.port_42_latch);
+	snap_w16(b, zzt.port_42);
+	snap_w8(b, zzt.port_61);
+	snap_w8(b, zzt.port_201);
+
+	snap_w32(b, zzt.dos_dta);
+}
+
+static void zzt_snapshot_read_state(zzt_snapshot_buf *b) {
+	cpu_state *cpu = &(zzt.cpu);
+
+	cpu->ax = snap_r16(b); cpu->cx = snap_r16(b); cpu->dx = snap_r16(b); cpu->bx = snap_r16(b);
+	cpu->sp = snap_r16(b); cpu->bp = snap_r16(b); cpu->si = snap_r16(b); cpu->di = snap_r16(b);
+	for (int i = 0; i < 4; i++) cpu->seg[i] = snap_r16(b);
+	cpu->ip = snap_r16(b);
+	cpu->flags = snap_r16(b);
+	cpu->segmod = snap_r8(b);
+	cpu->halted = snap_r8(b);
+	cpu->keep_going = snap_r32(b);
+	cpu->cycles = snap_r32(b);
+	cpu->intq_pos = snap_r16(b);
+	if (cpu->intq_pos > MAX_INTQUEUE_SIZE) cpu->intq_pos = MAX_INTQUEUE_SIZE;
+	for (int i = 0; i < MAX_INTQUEUE_SIZE; i++) cpu->intq[i] = snap_r8(b);
+
+	zzt.timer_time_offset = (s32) snap_r32(b);
+	u64 timer_bits = snap_r32(b);
+	timer_bits |= ((u64) snap_r32(b)) << 32;
+	memcpy(&(zzt.timer_time), &timer_bits, sizeof(timer_bits));
+
+	zzt.video_mode = snap_r8(b);
+	zzt.chr_width = snap_r8(b);
+	zzt.chr_height = snap_r8(b);
+	for (int i = 0; i < 256 * 16; i++) zzt.charset[i] = snap_r8(b);
+	for (int i = 0; i < 16; i++) zzt.palette[i] = snap_r32(b);
+
+	zzt.key_delay = snap_r16(b);
+	zzt.key_repeat_delay = snap_r16(b);
+	int keybuf_size = snap_r16(b);
+	int keybuf_count = snap_r16(b);
+	zzt_key_set_buffer_size(keybuf_size);
+	zzt_keybuf_clear();
+	for (int i = 0; i < keybuf_size; i++) {
+		int qch = snap_r8(b);
+		int qke = (s16) snap_r16(b);
+		if (i < keybuf_count && i < zzt.keybuf_size) {
+			zzt.keybuf[i].qch = qch;
+			zzt.keybuf[i].qke = qke;
+			zzt.keybuf_pending[qke & 0xFF]++;
+			zzt.keybuf_count++;
+		}
+	}
+	zzt.kmod = snap_r8(b);
+	zzt.kbd_call_time = (s32) snap_r32(b);
+	zzt.kbd_call_count = snap_r8(b);
+
+	zzt.joy_xstrobe_val = snap_r8(b); zzt.joy_ystrobe_val = snap_r8(b);
+	zzt.joy_xstrobes = snap_r8(b); zzt.joy_ystrobes = snap_r8(b);
+
+	zzt.mouse_buttons = snap_r16(b);
+	zzt.mouse_x = snap_r16(b); zzt.mouse_y = snap_r16(b);
+	zzt.mouse_xd = snap_r16(b); zzt.mouse_yd = snap_r16(b);
+
+	zzt.cga_status = snap_r8(b); zzt.cga_palette = snap_r8(b); zzt.cga_crt_index = snap_r8(b);
+	zzt.port_42_latch = snap_r8(b);
+	zzt.port_42 = snap_r16(b);
+	zzt.port_61 = snap_r8(b);
+	zzt.port_201 = snap_r8(b);
+
+	zzt.dos_dta = snap_r32(b);
+}
+
+int zzt_snapshot_save(u8 *data, int len) {
+	zzt_snapshot_buf b = {data, 0, len};
+
+	zzt_hle_check_cancel();
+
+	snap_w8(&b, 'Z'); snap_w8(&b, 'S'); snap_w8(&b, 'N'); snap_w8(&b, 'P');
+	snap_w16(&b, ZZT_SNAPSHOT_VERSION);
+
+	int state_len_pos = b.pos;
+	snap_w32(&b, 0);
+	zzt_snapshot_write_state(&b);
+	if (b.pos > b.len) return -1;
+	int state_len = b.pos - state_len_pos - 4;
+	b.pos = state_len_pos;
+	snap_w32(&b, state_len);
+	b.pos += state_len;
+
+	// memory pages touched since boot
+	int page_count = 0;
+	int page_count_pos = b.pos;
+	snap_w16(&b, 0);
+	for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+		if (!(zzt.cpu.ram_pages[i] & CPU_PAGE_TOUCHED)) continue;
+		if ((b.pos + 4) > b.len) return -1;
+
+		int enc_len = rle_encode(zzt.cpu.ram + (i << CPU_PAGE_SHIFT), CPU_PAGE_SIZE,
+			b.data + b.pos + 4, b.len - b.pos - 4);
+		if (enc_len < 0) return -1;
+		snap_w16(&b, i);
+		snap_w16(&b, enc_len);
+		b.pos += enc_len;
+		page_count++;
+	}
+
+	int end_pos = b.pos;
+	b.pos = page_count_pos;
+	snap_w16(&b, page_count);
+	return end_pos;
+}
+
+int zzt_snapshot_load(const u8 *data, int len) {
+	zzt_snapshot_buf b = {(u8*) data, 0, len};
+
+	// validate before touching any state
+	if (len < 12 || data[0] != 'Z' || data[1] != 'S' || data[2] != 'N' || data[3] != 'P') return -1;
+	b.pos = 4;
+	if (snap_r16(&b) != ZZT_SNAPSHOT_VERSION) return -2;
+	int state_pos = b.pos + 4;
+	int state_len = snap_r32(&b);
+	if (state_len < 0 || (state_pos + state_len + 2) > len) return -1;
+	b.pos = state_pos + state_len;
+
+	int page_count = snap_r16(&b);
+	int pages_pos = b.pos;
+	for (int i = 0; i < page_count; i++) {
+		if ((b.pos + 4) > len) return -1;
+		int idx = snap_r16(&b);
+		int enc_len = snap_r16(&b);
+		if (idx >= CPU_PAGE_COUNT || (b.pos + enc_len) > len) return -1;
+		if (rle_decode(data + b.pos, enc_len, NULL, CPU_PAGE_SIZE) != CPU_PAGE_SIZE) return -1;
+		b.pos += enc_len;
+	}
+
+	// restore
+	zzt_snapshot_buf sb = {(u8*) data + state_pos, 0, state_len};
+	zzt_snapshot_read_state(&sb);
+	// held keys belong to the frontend, not the snapshot
+	zzt.key.qke = -1;
+
+	u8 *ram_pages = zzt.cpu.ram_pages;
+	for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+		if (ram_pages[i] & CPU_PAGE_TOUCHED) {
+			memset(zzt.cpu.ram + (i << CPU_PAGE_SHIFT), 0, CPU_PAGE_SIZE);
+			ram_pages[i] = CPU_PAGE_ALL & ~CPU_PAGE_TOUCHED;
+		}
+	}
+
+	b.pos = pages_pos;
+	for (int i = 0; i < page_count; i++) {
+		int idx = snap_r16(&b);
+		int enc_len = snap_r16(&b);
+		rle_decode(data + b.pos, enc_len, zzt.cpu.ram + (idx << CPU_PAGE_SHIFT), CPU_PAGE_SIZE);
+		ram_pages[idx] = CPU_PAGE_ALL;
+		b.pos += enc_len;
+	}
+
+	zeta_update_charset(zzt.chr_width, zzt.chr_height, zzt.charset);
+	zeta_update_palette(zzt.palette);
+	return 0;
+}
+
+// forks
+//
+// Each f holds the machine state and a table of reference-counted
+// RAM pages, shared with other forks for as long as they stay equal.
+// zzt_fork_base is the page table the live RAM was last synchronized
+// with; only pages written since (CPU_PAGE_FORK) need to be copied.
+// A NULL page is all zeroes.
+
+#define ZZT_FORK_STATE_MAX 16384
+
+typedef struct {
+	int refcount;
+	u8 data[CPU_PAGE_SIZE];
+} zzt_fork_page;
+
+typedef struct {
+	zzt_fork_page *pages[CPU_PAGE_COUNT];
+	u8 *state;
+	int state_len;
+} zzt_fork;
+
+static zzt_fork_page *zzt_fork_base[CPU_PAGE_COUNT];
+static zzt_fork **zzt_forks;
+static int zzt_fork_count;
+
+static void zzt_fork_page_release(zzt_fork_page *page) {
+	if (page != NULL && (--page->refcount) <= 0) {
+		free(page);
+	}
+}
+
+static void zzt_fork_reset_base(void) {
+	for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+		zzt_fork_page_release(zzt_fork_base[i]);
+		zzt_fork_base[i] = NULL;
+	}
+}
+
+static int zzt_fork_sync_base(void) {
+	u8 *ram_pages = zzt.cpu.ram_pages;
+
+	for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+		if (!(ram_pages[i] & CPU_PAGE_FORK)) continue;
+
+		zzt_fork_page *page = malloc(sizeof(zzt_fork_page));
+		if (page == NULL) return -1;
+		page->refcount = 1;
+		memcpy(page->data, zzt.cpu.ram + (i << CPU_PAGE_SHIFT), CPU_PAGE_SIZE);
+		zzt_fork_page_release(zzt_fork_base[i]);
+		zzt_fork_base[i] = page;
+		ram_pages[i] &= ~CPU_PAGE_FORK;
+	}
+
+	return 0;
+}
+
+int zzt_fork_create(void) {
+	int id = 0;
+	zzt_hle_check_cancel();
+	while (id < zzt_fork_count && zzt_forks[id] != NULL) id++;
+	if (id == zzt_fork_count) {
+		int new_count = zzt_fork_count > 0 ? zzt_fork_count * 2 : 16;
+		zzt_fork **new_forks = realloc(zzt_forks, new_count * sizeof(zzt_fork*));
+		if (new_forks == NULL) return -1;
+		memset(new_forks + zzt_fork_count, 0, (new_count - zzt_fork_count) * sizeof(zzt_fork*));
+		zzt_forks = new_forks;
+		zzt_fork_count = new_count;
+	}
+
+	zzt_fork *f = malloc(sizeof(zzt_fork));
+	if (f == NULL) return -1;
+	f->state = malloc(ZZT_FORK_STATE_MAX);
+	if (f->state == NULL || zzt_fork_sync_base() < 0) {
+		free(f->state);
+		free(f);
+		return -1;
+	}
+
+	zzt_snapshot_buf b = {f->state, 0, ZZT_FORK_STATE_MAX};
+	zzt_snapshot_write_state(&b);
+	f->state_len = b.pos;
+
+	for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+		f->pages[i] = zzt_fork_base[i];
+		if (f->pages[i] != NULL) f->pages[i]->refcount++;
+	}
+
+	zzt_forks[id] = f;
+	// where files cannot be forked, the fork shares them
+	vfs_fork_create(id);
+	return id;
+}
+
+int zzt_fork_switch(int id) {
+	if (id < 0 || id >= zzt_fork_count || zzt_forks[id] == NULL) return -1;
+	zzt_fork *f = zzt_forks[id];
+	u8 *ram_pages = zzt.cpu.ram_pages;
+
+	for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+		zzt_fork_page *page = f->pages[i];
+		if (page == zzt_fork_base[i] && !(ram_pages[i] & CPU_PAGE_FORK)) continue;
+
+		u8 *ram = zzt.cpu.ram + (i << CPU_PAGE_SHIFT);
+		if (page != NULL) {
+			memcpy(ram, page->data, CPU_PAGE_SIZE);
+			page->refcount++;
+		} else {
+			memset(ram, 0, CPU_PAGE_SIZE);
+		}
+		zzt_fork_page_release(zzt_fork_base[i]);
+		zzt_fork_base[i] = page;
+		ram_pages[i] = CPU_PAGE_ALL & ~CPU_PAGE_FORK;
+	}
+
+	u8 old_charset[256*16];
+	u32 old_palette[16];
+	int old_chr_height = zzt.chr_height;
+	memcpy(old_charset, zzt.charset, sizeof(old_charset));
+	memcpy(old_palette, zzt.palette, sizeof(old_palette));
+
+	zzt_snapshot_buf b = {f->state, 0, f->state_len};
+	zzt_snapshot_read_state(&b);
+
+	// avoid needless frontend texture updates
+	if (old_chr_height != zzt.chr_height || memcmp(old_charset, zzt.charset, sizeof(old_charset)) != 0) {
+		zeta_update_charset(zzt.chr_width, zzt.chr_height, zzt.charset);
+	}
+	if (memcmp(old_palette, zzt.palette, sizeof(old_palette)) != 0) {
+		zeta_update_palette(zzt.palette);
+	}
+	vfs_fork_switch(id);
+	return 0;
+}
+
+void zzt_fork_free(int id) {
+	if (id < 0 || id >= zzt_fork_count || zzt_forks[id] == NULL) return;
+	zzt_fork *f = zzt_forks[id];
+
+	for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+		zzt_fork_page_release(f->pages[i]);
+	}
+	free(f->state);
+	free(f);
+	zzt_forks[id] = NULL;
+	vfs_fork_free(id);
+}
+
+// rewind
+//
+// Every interval ticks, the machine is captured as a delta against the
+// previous capture: the XOR of each page written since (CPU_PAGE_REWIND)
+// and of the serialized machine state, RLE-coded. As XOR is its own
+// inverse, applying the newest delta to the last capture (kept in full
+// in zzt_rewind_ram/zzt_rewind_state) yields the capture before it.
+
+typedef struct {
+	int interval, max_bytes;
+	int ticks;
+	u8 *ram; // RAM at the last capture, or NULL
+	u8 *state;
+	int state_len;
+	u8 *scratch;
+
+	// ring of deltas, oldest first
+	u8 **entries;
+	int *entry_lens;
+	int entry_first, entry_count, entry_capacity;
+	int bytes;
+
+	zzt_rewind_stats stats;
+} zzt_rewind_data;
+
+static zzt_rewind_data zzt_rewind_d;
+
+#define ZZT_REWIND_SCRATCH_SIZE (4 + CPU_PAGE_COUNT * (RLE_MAX_ENCODED_SIZE(CPU_PAGE_SIZE) + 4) + RLE_MAX_ENCODED_SIZE(ZZT_FORK_STATE_MAX))
+
+static void zzt_rewind_drop_oldest(void) {
+	zzt_rewind_data *r = &zzt_rewind_d;
+	int idx = r->entry_first;
+
+	r->bytes -= r->entry_lens[idx];
+	free(r->entries[idx]);
+	r->entries[idx] = NULL;
+	r->entry_first = (idx + 1) % r->entry_capacity;
+	r->entry_count--;
+}
+
+static void zzt_rewind_reset(void) {
+	zzt_rewind_data *r = &zzt_rewind_d;
+
+	while (r->entry_count > 0) zzt_rewind_drop_oldest();
+	free(r->ram);
+	r->ram = NULL;
+	r->ticks = 0;
+}
+
+static int zzt_rewind_push(u8 *data, int len) {
+	zzt_rewind_data *r = &zzt_rewind_d;
+
+	while (r->entry_count > 0 && (r->bytes + len) > r->max_bytes) {
+		zzt_rewind_drop_oldest();
+	}
+
+	if (r->entry_count == r->entry_capacity) {
+		int new_capacity = r->entry_capacity > 0 ? r->entry_capacity * 2 : 256;
+		u8 **new_entries = malloc(new_capacity * sizeof(u8*));
+		int *new_lens = malloc(new_capacity * sizeof(int));
+		if (new_entries == NULL || new_lens == NULL) {
+			free(new_entries);
+			free(new_lens);
+			return -1;
+		}
+		for (int i = 0; i < r->entry_count; i++) {
+			int idx = (r->entry_first + i) % r->entry_capacity;
+			new_entries[i] = r->entries[idx];
+			new_lens[i] = r->entry_lens[idx];
+		}
+		free(r->entries);
+		free(r->entry_lens);
+		r->entries = new_entries;
+		r->entry_lens = new_lens;
+		r->entry_first = 0;
+		r->entry_capacity = new_capacity;
+	}
+
+	u8 *entry = malloc(len);
+	if (entry == NULL) return -1;
+	memcpy(entry, data, len);
+
+	int idx = (r->entry_first + r->entry_count) % r->entry_capacity;
+	r->entries[idx] = entry;
+	r->entry_lens[idx] = len;
+	r->entry_count++;
+	r->bytes += len;
+	return 0;
+}
+
+static void zzt_rewind_capture(void) {
+	zzt_rewind_data *r = &zzt_rewind_d;
+	u8 *ram_pages = zzt.cpu.ram_pages;
+	u8 state[ZZT_FORK_STATE_MAX];
+	u8 page[CPU_PAGE_SIZE];
+	clock_t start = clock();
+
+	zzt_snapshot_buf sb = {state, 0, ZZT_FORK_STATE_MAX};
+	zzt_snapshot_write_state(&sb);
+
+	// the key buffer was resized; deltas need states of equal length
+	if (r->ram != NULL && sb.pos != r->state_len) {
+		zzt_rewind_reset();
+	}
+
+	if (r->ram == NULL) {
+		// first capture: full copy
+		r->ram = malloc(1048576);
+		if (r->ram == NULL) return;
+		memcpy(r->ram, zzt.cpu.ram, 1048576);
+		memcpy(r->state, state, sb.pos);
+		for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+			ram_pages[i] &= ~CPU_PAGE_REWIND;
+		}
+	} else {
+		zzt_snapshot_buf b = {r->scratch, 4, ZZT_REWIND_SCRATCH_SIZE};
+		int page_count = 0;
+
+		for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+			if (!(ram_pages[i] & CPU_PAGE_REWIND)) continue;
+			ram_pages[i] &= ~CPU_PAGE_REWIND;
+
+			u8 *ram = zzt.cpu.ram + (i << CPU_PAGE_SHIFT);
+			u8 *shadow = r->ram + (i << CPU_PAGE_SHIFT);
+			int changed = 0;
+			for (int j = 0; j < CPU_PAGE_SIZE; j++) {
+				page[j] = ram[j] ^ shadow[j];
+				changed |= page[j];
+			}
+			if (!changed) continue;
+			memcpy(shadow, ram, CPU_PAGE_SIZE);
+
+			int enc_len = rle_encode(page, CPU_PAGE_SIZE, b.data + b.pos + 4, b.len - b.pos - 4);
+			snap_w16(&b, i);
+			snap_w16(&b, enc_len);
+			b.pos += enc_len;
+			page_count++;
+		}
+
+		// the serialized state has a fixed length
+		for (int i = 0; i < sb.pos; i++) {
+			state[i] ^= r->state[i];
+			r->state[i] ^= state[i];
+		}
+		b.pos += rle_encode(state, sb.pos, b.data + b.pos, b.len - b.pos);
+
+		b.data[0] = page_count & 0xFF;
+		b.data[1] = page_count >> 8;
+		b.data[2] = sb.pos & 0xFF;
+		b.data[3] = sb.pos >> 8;
+		zzt_rewind_push(b.data, b.pos);
+
+		r->stats.pages_captured += page_count;
+	}
+
+	r->state_len = sb.pos;
+	r->stats.captures++;
+	r->stats.capture_us += (u64) (clock() - start) * 1000000 / CLOCKS_PER_SEC;
+}
+
+static void zzt_rewind_tick(void) {
+	zzt_rewind_data *r = &zzt_rewind_d;
+
+	if (r->interval <= 0 || zzt.speculative) return;
+	if ((++r->ticks) >= r->interval) {
+		r->ticks = 0;
+		zzt_rewind_capture();
+	}
+}
+
+int zzt_rewind_configure(int interval_ticks, int max_bytes) {
+	zzt_rewind_data *r = &zzt_rewind_d;
+
+	zzt_rewind_reset();
+	free(r->entries);
+	free(r->entry_lens);
+	free(r->state);
+	free(r->scratch);
+	memset(r, 0, sizeof(zzt_rewind_data));
+	if (interval_ticks <= 0) return 0;
+
+	r->state = malloc(ZZT_FORK_STATE_MAX);
+	r->scratch = malloc(ZZT_REWIND_SCRATCH_SIZE);
+	if (r->state == NULL || r->scratch == NULL) {
+		free(r->state);
+		free(r->scratch);
+		r->state = NULL;
+		r->scratch = NULL;
+		return -1;
+	}
+
+	r->interval = interval_ticks;
+	r->max_bytes = max_bytes;
+	return 0;
+}
+
+int zzt_rewind_count(void) {
+	zzt_rewind_data *r = &zzt_rewind_d;
+	return r->ram != NULL ? r->entry_count + 1 : 0;
+}
+
+int zzt_rewind(int steps) {
+	zzt_rewind_data *r = &zzt_rewind_d;
+	u8 *ram_pages = zzt.cpu.ram_pages;
+	u8 page[CPU_PAGE_SIZE];
+
+	if (steps < 1 || steps > zzt_rewind_count()) return -1;
+
+	// undo the changes since the last capture
+	for (int i = 0; i < CPU_PAGE_COUNT; i++) {
+		if (ram_pages[i] & CPU_PAGE_REWIND) {
+			memcpy(zzt.cpu.ram + (i << CPU_PAGE_SHIFT), r->ram + (i << CPU_PAGE_SHIFT), CPU_PAGE_SIZE);
+			ram_pages[i] = CPU_PAGE_ALL & ~CPU_PAGE_REWIND;
+		}
+	}
+
+	// then walk back through the deltas, newest first
+	for (int s = 1; s < steps; s++) {
+		int idx = (r->entry_first + r->entry_count - 1) % r->entry_capacity;
+		zzt_snapshot_buf b = {r->entries[idx], 0, r->entry_lens[idx]};
+		int page_count = snap_r16(&b);
+		int state_len = snap_r16(&b);
+
+		for (int i = 0; i < page_count; i++) {
+			int pidx = snap_r16(&b);
+			int enc_len = snap_r16(&b);
+			u8 *ram = zzt.cpu.ram + (pidx << CPU_PAGE_SHIFT);
+			u8 *shadow = r->ram + (pidx << CPU_PAGE_SHIFT);
+
+			rle_decode(b.data + b.pos, enc_len, page, CPU_PAGE_SIZE);
+			b.pos += enc_len;
+			for (int j = 0; j < CPU_PAGE_SIZE; j++) {
+				shadow[j] ^= page[j];
+			}
+			memcpy(ram, shadow, CPU_PAGE_SIZE);
+			ram_pages[pidx] = CPU_PAGE_ALL & ~CPU_PAGE_REWIND;
+		}
+
+		u8 state[ZZT_FORK_STATE_MAX];
+		rle_decode(b.data + b.pos, b.len - b.pos, state, state_len);
+		for (int i = 0; i < state_len; i++) {
+			r->state[i] ^= state[i];
+		}
+
+		r->bytes -= r->entry_lens[idx];
+		free(r->entries[idx]);
+		r->entries[idx] = NULL;
+		r->entry_count--;
+	}
+
+	zzt_snapshot_buf sb = {r->state, 0, r->state_len};
+	zzt_snapshot_read_state(&sb);
+	zeta_update_charset(zzt.chr_width, zzt.chr_height, zzt.charset);
+	zeta_update_palette(zzt.palette);
+	r->ticks = 0;
+	return 0;
+}
+
+void zzt_rewind_get_stats(zzt_rewind_stats *stats) {
+	zzt_rewind_data *r = &zzt_rewind_d;
+
+	*stats = r->stats;
+	stats->entries = zzt_rewind_count();
+	stats->bytes = r->bytes + (r->ram != NULL ? (1048576 + ZZT_FORK_STATE_MAX + ZZT_REWIND_SCRATCH_SIZE) : 0);
+}
+
+// run-ahead
+
+#define ZZT_RUN_AHEAD_TICK_OPCODES 500000
+
+int zzt_run_ahead(int ticks, u8 *vram) {
+	int id = zzt_fork_create();
+	if (id < 0) return -1;
+
+	// key repeat state is kept outside of forks
+	zzt_key_entry key = zzt.key;
+	zzt.speculative = 1;
+	zzt.speculation_stopped = 0;
+	for (int i = 0; i < ticks && !zzt.speculation_stopped; i++) {
+		zzt_mark_timer();
+		// run until the engine yields, as it would in real time
+		int rcode = STATE_CONTINUE;
+		for (int opcodes = 0; opcodes < ZZT_RUN_AHEAD_TICK_OPCODES && rcode == STATE_CONTINUE; opcodes += 10000) {
+			rcode = zzt_execute(10000);
+		}
+		if (rcode == STATE_END) break;
+	}
+	memcpy(vram, zzt.cpu.ram + 0xB8000, 80*25*2);
+	zzt.speculative = 0;
+	zzt.speculation_stopped = 0;
+
+	zzt_fork_switch(id);
+	zzt_fork_free(id);
+	zzt.key = key;
+	return 0;
+}
+
+// native routines
+//
+// Hot engine routines are located by signature when a binary is loaded,
+// so modified engines simply keep running interpreted. Each site found
+// is patched with an INT ZZT_HLE_VECTOR, which runs the native version.
+// In verification mode, every native run is checked against the
+// interpreted code; on the first mismatch, all sites are unpatched.
+// The interpreted run is not nested in the trap: the sites are unpatched,
+// the trap returns to the original code, and a second trap placed where
+// the routine exits compares the results.
+//
+// Matched are the VIDEO unit's output loop and, from the runtime library,
+// the generator behind Random and the longint multiply helper. The byte
+// patterns of the latter two follow the Turbo Pascal runtime sources and
+// have not been checked against every engine build; one built differently
+// keeps running them interpreted, and verification mode catches a pattern
+// that matches code doing something else. The longint divide helper stays
+// interpreted: its code differs between runtime versions, and no pattern
+// is matched without a build to check it against. Move, FillChar and the
+// string routines are served by the CPU's native REP loops instead.
+
+#define ZZT_HLE_MAX_SITES 16
+#define ZZT_HLE_MAX_CODE 64
+#define SEG_ADDR(s, o) (((((u32) (s)) << 4) + ((u16) (o))) & 0xFFFFF)
+
+// where the native version returns to
+#define ZZT_HLE_EXIT_PAST 0 // past the code, with interrupts enabled (STI)
+#define ZZT_HLE_EXIT_RET 1
+#define ZZT_HLE_EXIT_RETF 2
+
+typedef struct zzt_hle_site zzt_hle_site;
+
+typedef struct {
+	const u8 *sig;
+	u8 len;
+	u8 exit;
+	u64 wild; // bit n set: byte n differs between builds
+	// checks what the signature cannot; for a patched site, also restores
+	// the wildcard bytes the INT replaced. May be NULL
+	int (*match)(u8 *code, int patched);
+	// whether the native version applies in the current state. May be NULL
+	int (*check)(cpu_state* cpu, zzt_hle_site* site);
+	void (*run)(cpu_state* cpu, zzt_hle_site* site);
+	// memory written besides the registers, for verification
+	u32 (*output)(cpu_state* cpu, zzt_hle_site* site, int *len);
+} zzt_hle_routine;
+
+struct zzt_hle_site {
+	u32 addr; // linear address of the first instruction
+	u16 cs; // code segment of the last call
+	const zzt_hle_routine *routine;
+	u8 code[ZZT_HLE_MAX_CODE]; // the original code
+};
+
+typedef struct {
+	int pending;
+	u32 site_addr;
+	u32 exit_addr; // linear address of the exit trap
+	u8 orig[2]; // the code the exit trap replaced
+	u16 regs[9]; // native results
+	u32 output_addr;
+	int output_len;
+	u8 output[80*25*2];
+} zzt_hle_check_state;
+
+static int zzt_hle_mode = ZZT_HLE_ON;
+static zzt_hle_site zzt_hle_sites[ZZT_HLE_MAX_SITES];
+static int zzt_hle_site_count;
+static u64 zzt_hle_engine_hash;
+static zzt_hle_check_state zzt_hle_check;
+
+static u16 zzt_hle_code16(zzt_hle_site* site, int offset) {
+	return site->code[offset] | (site->code[offset + 1] << 8);
+}
+
+static u16 zzt_hle_peek16(cpu_state* cpu, u16 seg, u16 offset) {
+	return cpu->ram[SEG_ADDR(seg, offset)] | (cpu->ram[SEG_ADDR(seg, offset + 1)] << 8);
+}
+
+static void zzt_hle_poke16(cpu_state* cpu, u16 seg, u16 offset, u16 value) {
+	u32 addr = SEG_ADDR(seg, offset);
+	u32 addr_hi = SEG_ADDR(seg, offset + 1);
+
+	cpu->ram[addr] = value & 0xFF;
+	cpu->ram[addr_hi] = value >> 8;
+	cpu_mark_ram(cpu, addr, 1);
+	cpu_mark_ram(cpu, addr_hi, 1);
+}
+
+// the flags of a 16-bit ADD or ADC, as the interpreter sets them
+static void zzt_hle_flags_add(cpu_state* cpu, u16 v1, u16 v2, u8 carry) {
+	u32 vr = v1 + v2 + carry;
+	u8 p = vr ^ (vr >> 4);
+	p ^= p >> 2;
+	p ^= p >> 1;
+
+	cpu->flags &= ~(FLAG_CARRY | FLAG_PARITY | FLAG_ADJUST | FLAG_ZERO | FLAG_SIGN | FLAG_OVERFLOW);
+	if (vr > 0xFFFF) cpu->flags |= FLAG_CARRY;
+	if (!(p & 1)) cpu->flags |= FLAG_PARITY;
+	if (((v1 & 0xF) + (v2 & 0xF) + carry) >= 0x10) cpu->flags |= FLAG_ADJUST;
+	if ((vr & 0xFFFF) == 0) cpu->flags |= FLAG_ZERO;
+	if (vr & 0x8000) cpu->flags |= FLAG_SIGN;
+	if (((v1 ^ v2) & 0x8000) == 0 && ((v1 ^ vr) & 0x8000) != 0) cpu->flags |= FLAG_OVERFLOW;
+}
+
+// The VIDEO unit's text output loop (ZZT 3.2, Super ZZT 2.0): waits for
+// CGA horizontal retrace before writing each character and attribute.
+static const u8 zzt_hle_cga_write_sig[] = {
+	0x8A, 0x9A, 0x00, 0x00, // MOV BL, [BP + SI + disp]
+	0xEC, 0xA8, 0x01, 0x75, 0xFB, // IN AL, DX; TEST AL, 1; JNZ $-5
+	0xFA, // CLI
+	0xEC, 0xA8, 0x01, 0x74, 0xFB, // IN AL, DX; TEST AL, 1; JZ $-5
+	0x26, 0x89, 0x1D, // MOV ES:[DI], BX
+	0x47, 0x47, 0xFB, 0x46, // INC DI; INC DI; STI; INC SI
+	0xFE, 0xC9, 0x75, 0xE6 // DEC CL; JNZ start
+};
+
+static int zzt_hle_cga_write_check(cpu_state* cpu, zzt_hle_site* site) {
+	if (cpu->dx == 0x3DA) return 1;
+	// only the CGA status port toggles; waiting on any other
+	// port is left to the interpreter
+	zzt_log(ZZT_LOG_NATIVE, site->addr & 0xFFFF, "native routine at %05X polls port %04X, disabling", site->addr, cpu->dx);
+	return 0;
+}
+
+static void zzt_hle_cga_write(cpu_state* cpu, zzt_hle_site* site) {
+	u8 *ram = cpu->ram;
+	u16 disp = zzt_hle_code16(site, 2);
+
+	do {
+		cpu->bl = ram[SEG_ADDR(cpu->seg[SEG_SS], cpu->bp + cpu->si + disp)];
+		while ((cpu->al = cpu->func_port_in(cpu, cpu->dx)) & 1) { }
+		while (!((cpu->al = cpu->func_port_in(cpu, cpu->dx)) & 1)) { }
+		u32 dst = SEG_ADDR(cpu->seg[SEG_ES], cpu->di);
+		u32 dst_hi = SEG_ADDR(cpu->seg[SEG_ES], (u16) (cpu->di + 1));
+		ram[dst] = cpu->bl;
+		ram[dst_hi] = cpu->bh;
+		cpu_mark_ram(cpu, dst, 1);
+		cpu_mark_ram(cpu, dst_hi, 1);
+		cpu->di += 2;
+		cpu->si++;
+	} while ((--cpu->cl) != 0);
+
+	// TEST AL, 1 cleared CF/OF; DEC CL left ZF and PF set
+	cpu->flags &= ~(FLAG_CARRY | FLAG_PARITY | FLAG_ADJUST | FLAG_ZERO | FLAG_SIGN | FLAG_OVERFLOW);
+	cpu->flags |= FLAG_ZERO | FLAG_PARITY;
+}
+
+static u32 zzt_hle_cga_write_output(cpu_state* cpu, zzt_hle_site* site, int *len) {
+	*len = 80*25*2;
+	return 0xB8000;
+}
+
+// The runtime library's random number generator, called by Random:
+// RandSeed = RandSeed * 08088405h + 1.
+static const u8 zzt_hle_rand_sig[] = {
+	0xA1, 0x00, 0x00, // MOV AX, [RandSeed]
+	0x8B, 0x1E, 0x00, 0x00, // MOV BX, [RandSeed + 2]
+	0x8B, 0xC8, // MOV CX, AX
+	0x2E, 0xF7, 0x26, 0x00, 0x00, // MUL CS:[factor]
+	0xD1, 0xE1, 0xD1, 0xE1, 0xD1, 0xE1, // SHL CX, 1 (3x)
+	0x02, 0xE9, 0x03, 0xD1, 0x03, 0xD3, // ADD CH, CL; ADD DX, CX; ADD DX, BX
+	0xD1, 0xE3, 0xD1, 0xE3, // SHL BX, 1 (2x)
+	0x03, 0xD3, 0x02, 0xF3, // ADD DX, BX; ADD DH, BL
+	0xB1, 0x05, 0xD3, 0xE3, 0x02, 0xF3, // MOV CL, 5; SHL BX, CL; ADD DH, BL
+	0x05, 0x01, 0x00, 0x83, 0xD2, 0x00, // ADD AX, 1; ADC DX, 0
+	0xA3, 0x00, 0x00, // MOV [RandSeed], AX
+	0x89, 0x16, 0x00, 0x00, // MOV [RandSeed + 2], DX
+	0xC3 // RET
+};
+
+static int zzt_hle_rand_match(u8 *code, int patched) {
+	// the INT replaced the low byte of the seed's address
+	if (patched) code[1] = code[47];
+	u16 seed = code[1] | (code[2] << 8);
+	u16 seed_hi = code[5] | (code[6] << 8);
+	return code[47] == code[1] && code[48] == code[2]
+		&& code[51] == code[5] && code[52] == code[6]
+		&& seed_hi == (u16) (seed + 2);
+}
+
+static int zzt_hle_rand_check(cpu_state* cpu, zzt_hle_site* site) {
+	u16 factor = zzt_hle_peek16(cpu, site->cs, zzt_hle_code16(site, 12));
+	if (factor == 0x8405) return 1;
+	zzt_log(ZZT_LOG_NATIVE, site->addr & 0xFFFF, "native routine at %05X multiplies by %04X, disabling", site->addr, factor);
+	return 0;
+}
+
+static void zzt_hle_rand(cpu_state* cpu, zzt_hle_site* site) {
+	u16 seed = zzt_hle_code16(site, 1);
+	u16 lo = zzt_hle_peek16(cpu, cpu->seg[SEG_DS], seed);
+	u16 hi = zzt_hle_peek16(cpu, cpu->seg[SEG_DS], seed + 2);
+	u32 product = lo * 0x8405U;
+
+	// the same steps, for the registers they leave behind
+	cpu->cx = lo << 3;
+	cpu->ch += cpu->cl;
+	cpu->dx = (product >> 16) + cpu->cx + hi;
+	cpu->bx = hi << 2;
+	cpu->dx += cpu->bx;
+	cpu->dh += cpu->bl;
+	cpu->cl = 5;
+	cpu->bx <<= 5;
+	cpu->dh += cpu->bl;
+	cpu->ax = product + 1;
+
+	u8 carry = (product & 0xFFFF) == 0xFFFF;
+	zzt_hle_flags_add(cpu, 0, cpu->dx, carry);
+	cpu->dx += carry;
+
+	zzt_hle_poke16(cpu, cpu->seg[SEG_DS], seed, cpu->ax);
+	zzt_hle_poke16(cpu, cpu->seg[SEG_DS], seed + 2, cpu->dx);
+}
+
+static u32 zzt_hle_rand_output(cpu_state* cpu, zzt_hle_site* site, int *len) {
+	*len = 4;
+	return SEG_ADDR(cpu->seg[SEG_DS], zzt_hle_code16(site, 1));
+}
+
+// The runtime library's longint multiply: DX:AX = DX:AX * BX:CX.
+static const u8 zzt_hle_long_mul_sig[] = {
+	0x8B, 0xF2, 0x8B, 0xF8, // MOV SI, DX; MOV DI, AX
+	0x8B, 0xC6, 0xF7, 0xE1, 0x96, // MOV AX, SI; MUL CX; XCHG AX, SI
+	0x8B, 0xC7, 0xF7, 0xE3, 0x03, 0xF0, // MOV AX, DI; MUL BX; ADD SI, AX
+	0x8B, 0xC7, 0xF7, 0xE1, 0x03, 0xD6, // MOV AX, DI; MUL CX; ADD DX, SI
+	0xCB // RETF
+};
+
+static void zzt_hle_long_mul(cpu_state* cpu, zzt_hle_site* site) {
+	u16 lo = cpu->ax;
+	u16 hi = cpu->dx;
+	u32 product = lo * (u32) cpu->cx;
+
+	cpu->si = (u16) (hi * cpu->cx) + (u16) (lo * cpu->bx);
+	cpu->di = lo;
+	cpu->ax = product;
+	zzt_hle_flags_add(cpu, cpu->si, product >> 16, 0);
+	cpu->dx = (product >> 16) + cpu->si;
+}
+
+static const zzt_hle_routine zzt_hle_routines[] = {
+	{zzt_hle_cga_write_sig, sizeof(zzt_hle_cga_write_sig), ZZT_HLE_EXIT_PAST, 0xCULL,
+		NULL, zzt_hle_cga_write_check, zzt_hle_cga_write, zzt_hle_cga_write_output},
+	{zzt_hle_rand_sig, sizeof(zzt_hle_rand_sig), ZZT_HLE_EXIT_RET, 0x19800000003066ULL,
+		zzt_hle_rand_match, zzt_hle_rand_check, zzt_hle_rand, zzt_hle_rand_output},
+	{zzt_hle_long_mul_sig, sizeof(zzt_hle_long_mul_sig), ZZT_HLE_EXIT_RETF, 0,
+		NULL, NULL, zzt_hle_long_mul, NULL}
+};
+
+#define ZZT_HLE_ROUTINE_COUNT ((int) (sizeof(zzt_hle_routines) / sizeof(zzt_hle_routine)))
+
+static void zzt_hle_patch(int enable) {
+	u8 *ram = zzt.cpu.ram;
+
+	for (int i = 0; i < zzt_hle_site_count; i++) {
+		zzt_hle_site *site = &zzt_hle_sites[i];
+		if (memcmp(ram + site->addr + 2, site->code + 2, site->routine->len - 2) != 0) {
+			continue; // overwritten since
+		}
+		if (enable) {
+			ram[site->addr] = 0xCD;
+			ram[site->addr + 1] = ZZT_HLE_VECTOR;
+		} else {
+			ram[site->addr] = site->code[0];
+			ram[site->addr + 1] = site->code[1];
+		}
+		cpu_mark_ram(&(zzt.cpu), site->addr, 2);
+	}
+}
+
+static void zzt_hle_reset(void) {
+	zzt_hle_check.pending = 0;
+	zzt_hle_site_count = 0;
+	zzt_hle_engine_hash = 0;
+}
+
+static zzt_hle_site *zzt_hle_add_site(u32 addr, int patched) {
+	u8 *p = zzt.cpu.ram + addr;
+
+	if (zzt_hle_site_count >= ZZT_HLE_MAX_SITES) return NULL;
+	if (patched && (p[0] != 0xCD || p[1] != ZZT_HLE_VECTOR)) return NULL;
+
+	for (int i = 0; i < ZZT_HLE_ROUTINE_COUNT; i++) {
+		const zzt_hle_routine *routine = &zzt_hle_routines[i];
+		int j;
+
+		if (addr + routine->len > 0x100000) continue;
+		for (j = patched ? 2 : 0; j < routine->len; j++) {
+			if (!((routine->wild >> j) & 1) && p[j] != routine->sig[j]) break;
+		}
+		if (j < routine->len) continue;
+
+		zzt_hle_site *site = &zzt_hle_sites[zzt_hle_site_count];
+		memcpy(site->code, p, routine->len);
+		if (patched) {
+			site->code[0] = routine->sig[0];
+			site->code[1] = routine->sig[1];
+		}
+		if (routine->match != NULL && !routine->match(site->code, patched)) continue;
+
+		site->addr = addr;
+		site->routine = routine;
+		zzt_hle_site_count++;
+		return site;
+	}
+	return NULL;
+}
+
+static void zzt_hle_scan(u32 addr, int len) {
+	u8 *ram = zzt.cpu.ram;
+
+	// the new image replaces the previous one; sites left patched
+	// elsewhere are picked up again by the trap handler
+	zzt_hle_check_cancel();
+	zzt_hle_site_count = 0;
+	if (addr + len > 0x100000) len = 0x100000 - addr;
+
+	u64 h = zzt_hash_bytes(0xCBF29CE484222325ULL, ram + addr, len);
+	zzt_hle_engine_hash = h;
+
+	for (int i = 0; i < len; i++) {
+		for (int j = 0; j < ZZT_HLE_ROUTINE_COUNT; j++) {
+			if (ram[addr + i] == zzt_hle_routines[j].sig[0]) {
+				zzt_hle_add_site(addr + i, 0);
+				break;
+			}
+		}
+	}
+
+	zzt_log(ZZT_LOG_NATIVE, 0, "engine %016llX: %d native routine(s)", (unsigned long long) h, zzt_hle_site_count);
+	if (zzt_hle_mode != ZZT_HLE_OFF) zzt_hle_patch(1);
+}
+
+// the address the site's code exits to, as the interpreter would reach it
+static u32 zzt_hle_exit_addr(cpu_state* cpu, zzt_hle_site* site, u16 ret_cs, u16 ret_ip) {
+	u16 sp = cpu->sp + 6;
+
+	switch (site->routine->exit) {
+		case ZZT_HLE_EXIT_RET:
+			return SEG_ADDR(ret_cs, zzt_hle_peek16(cpu, cpu->seg[SEG_SS], sp));
+		case ZZT_HLE_EXIT_RETF:
+			return SEG_ADDR(zzt_hle_peek16(cpu, cpu->seg[SEG_SS], sp + 2), zzt_hle_peek16(cpu, cpu->seg[SEG_SS], sp));
+		default:
+			return SEG_ADDR(ret_cs, ret_ip - 2 + site->routine->len);
+	}
+}
+
+// makes the trap's IRET leave the site's code the way it would exit
+static void zzt_hle_exit(cpu_state* cpu, zzt_hle_site* site, u16 ret_cs, u16 ret_ip, u16 ret_flags) {
+	u16 ss = cpu->seg[SEG_SS];
+	u16 sp = cpu->sp;
+
+	switch (site->routine->exit) {
+		case ZZT_HLE_EXIT_RET: {
+			u16 ip = zzt_hle_peek16(cpu, ss, sp + 6);
+			cpu->sp += 2;
+			zzt_hle_poke16(cpu, ss, cpu->sp, ip);
+			zzt_hle_poke16(cpu, ss, cpu->sp + 2, ret_cs);
+			zzt_hle_poke16(cpu, ss, cpu->sp + 4, ret_flags);
+		} break;
+		case ZZT_HLE_EXIT_RETF: {
+			u16 ip = zzt_hle_peek16(cpu, ss, sp + 6);
+			u16 cs = zzt_hle_peek16(cpu, ss, sp + 8);
+			cpu->sp += 4;
+			zzt_hle_poke16(cpu, ss, cpu->sp, ip);
+			zzt_hle_poke16(cpu, ss, cpu->sp + 2, cs);
+			zzt_hle_poke16(cpu, ss, cpu->sp + 4, ret_flags);
+		} break;
+		default:
+			zzt_hle_poke16(cpu, ss, sp, ret_ip - 2 + site->routine->len);
+			zzt_hle_poke16(cpu, ss, sp + 4, ret_flags | FLAG_INTERRUPT);
+			break;
+	}
+}
+
+static void zzt_hle_check_unpatch(void) {
+	u8 *ram = zzt.cpu.ram;
+	u32 addr = zzt_hle_check.exit_addr;
+	u32 addr_hi = (addr & 0xF0000) | ((addr + 1) & 0xFFFF);
+
+	ram[addr] = zzt_hle_check.orig[0];
+	ram[addr_hi] = zzt_hle_check.orig[1];
+	cpu_mark_ram(&(zzt.cpu), addr, 1);
+	cpu_mark_ram(&(zzt.cpu), addr_hi, 1);
+	zzt_hle_check.pending = 0;
+}
+
+// snapshots and forks must not capture the exit trap; the routine being
+// checked runs natively again from its next call
+static void zzt_hle_check_cancel(void) {
+	if (!zzt_hle_check.pending) return;
+	zzt_hle_check_unpatch();
+	if (zzt_hle_mode != ZZT_HLE_OFF) zzt_hle_patch(1);
+}
+
+static int zzt_hle_verify(cpu_state* cpu, zzt_hle_site* site, u32 frame, u16 ret_cs, u16 ret_ip, u16 ret_flags) {
+	const zzt_hle_routine *routine = site->routine;
+	u32 addr = zzt_hle_exit_addr(cpu, site, ret_cs, ret_ip);
+	u32 addr_hi = (addr & 0xF0000) | ((addr + 1) & 0xFFFF);
+
+	int id = zzt_fork_create();
+	if (id < 0) return -1;
+	routine->run(cpu, site);
+	u16 sp = cpu->sp + 6 + (routine->exit == ZZT_HLE_EXIT_RET ? 2 : routine->exit == ZZT_HLE_EXIT_RETF ? 4 : 0);
+	u16 flags = (routine->exit == ZZT_HLE_EXIT_PAST) ? (cpu->flags | FLAG_INTERRUPT)
+		: ((cpu->flags & ~FLAG_INTERRUPT) | (ret_flags & FLAG_INTERRUPT));
+	u16 regs[9] = {cpu->ax, cpu->bx, cpu->cx, cpu->dx, cpu->si, cpu->di, cpu->bp, sp, flags};
+	memcpy(zzt_hle_check.regs, regs, sizeof(regs));
+	zzt_hle_check.output_len = 0;
+	if (routine->output != NULL) {
+		zzt_hle_check.output_addr = routine->output(cpu, site, &zzt_hle_check.output_len);
+		memcpy(zzt_hle_check.output, cpu->ram + zzt_hle_check.output_addr, zzt_hle_check.output_len);
+	}
+	zzt_fork_switch(id);
+	zzt_fork_free(id);
+
+	// return to the original code, and trap again once it is done
+	zzt_hle_patch(0);
+	cpu->ram[frame] = (ret_ip - 2) & 0xFF;
+	cpu->ram[frame + 1] = (ret_ip - 2) >> 8;
+	cpu_mark_ram(cpu, frame, 2);
+
+	zzt_hle_check.site_addr = site->addr;
+	zzt_hle_check.exit_addr = addr;
+	zzt_hle_check.orig[0] = cpu->ram[addr];
+	zzt_hle_check.orig[1] = cpu->ram[addr_hi];
+	cpu->ram[addr] = 0xCD;
+	cpu->ram[addr_hi] = ZZT_HLE_VECTOR;
+	cpu_mark_ram(cpu, addr, 1);
+	cpu_mark_ram(cpu, addr_hi, 1);
+	zzt_hle_check.pending = 1;
+	return 0;
+}
+
+static void zzt_hle_verify_exit(cpu_state* cpu, u32 frame, u16 ret_ip, u16 ret_flags) {
+	u16 regs[9] = {cpu->ax, cpu->bx, cpu->cx, cpu->dx, cpu->si, cpu->di, cpu->bp, cpu->sp + 6, ret_flags};
+	int ok = memcmp(regs, zzt_hle_check.regs, sizeof(regs)) == 0
+		&& memcmp(cpu->ram + zzt_hle_check.output_addr, zzt_hle_check.output, zzt_hle_check.output_len) == 0;
+
+	// return to the code the exit trap replaced
+	zzt_hle_check_unpatch();
+	cpu->ram[frame] = (ret_ip - 2) & 0xFF;
+	cpu->ram[frame + 1] = (ret_ip - 2) >> 8;
+	cpu_mark_ram(cpu, frame, 2);
+
+	if (!ok) {
+		zzt_log(ZZT_LOG_NATIVE, zzt_hle_check.site_addr & 0xFFFF, "native routine at %05X does not match, disabling", zzt_hle_check.site_addr);
+		zzt_hle_mode = ZZT_HLE_OFF;
+		return;
+	}
+	if (zzt_hle_mode != ZZT_HLE_OFF) zzt_hle_patch(1);
+}
+
+static int zzt_hle_trap(cpu_state* cpu) {
+	u32 frame = SEG_ADDR(cpu->seg[SEG_SS], cpu->sp);
+	u16 ret_ip = cpu->ram[frame] | (cpu->ram[frame + 1] << 8);
+	u16 ret_cs = cpu->ram[frame + 2] | (cpu->ram[frame + 3] << 8);
+	u16 ret_flags = cpu->ram[frame + 4] | (cpu->ram[frame + 5] << 8);
+	u32 addr = SEG_ADDR(ret_cs, (u16) (ret_ip - 2));
+
+	if (zzt_hle_check.pending && addr == zzt_hle_check.exit_addr) {
+		zzt_hle_verify_exit(cpu, frame, ret_ip, ret_flags);
+		return STATE_CONTINUE;
+	}
+
+	for (int i = 0; i <= zzt_hle_site_count; i++) {
+		zzt_hle_site *site = &zzt_hle_sites[i];
+		// sites patched before a snapshot was saved are picked up here
+		if (i == zzt_hle_site_count) site = zzt_hle_add_site(addr, 1);
+		else if (site->addr != addr) continue;
+		if (site == NULL) break;
+
+		site->cs = ret_cs;
+		if (zzt_hle_mode != ZZT_HLE_OFF && site->routine->check != NULL && !site->routine->check(cpu, site)) {
+			zzt_hle_mode = ZZT_HLE_OFF;
+		}
+
+		if (zzt_hle_mode == ZZT_HLE_VERIFY && zzt_hle_verify(cpu, site, frame, ret_cs, ret_ip, ret_flags) < 0) {
+			zzt_hle_mode = ZZT_HLE_OFF;
+		}
+
+		if (zzt_hle_mode == ZZT_HLE_OFF) {
+			// restore the original code and run it instead
+			zzt_hle_patch(0);
+			cpu->ram[frame] = (ret_ip - 2) & 0xFF;
+			cpu->ram[frame + 1] = (ret_ip - 2) >> 8;
+			cpu_mark_ram(cpu, frame, 2);
+		} else if (zzt_hle_mode == ZZT_HLE_ON) {
+			site->routine->run(cpu, site);
+			zzt_hle_exit(cpu, site, ret_cs, ret_ip, ret_flags);
+		}
+		return STATE_CONTINUE;
+	}
+
+	zzt_log(ZZT_LOG_INTERRUPT, ZZT_HLE_VECTOR << 8, "unknown interrupt %02X %04X", ZZT_HLE_VECTOR, cpu->ax);
+	return STATE_CONTINUE;
+}
+
+void zzt_hle_set_mode(int mode) {
+	zzt_hle_check_cancel();
+	if (zzt_hle_mode != ZZT_HLE_OFF && mode == ZZT_HLE_OFF) zzt_hle_patch(0);
+	if (zzt_hle_mode == ZZT_HLE_OFF && mode != ZZT_HLE_OFF) zzt_hle_patch(1);
+	zzt_hle_mode = mode;
+}
+
+u64 zzt_get_engine_hash(void) {
+	return zzt_hle_engine_hash;
+}
+
+// game state observation
+//
+// The locations of World.Info and Board are found once per engine and
+// cached as linear addresses, after which every query is a handful of
+// loads. World.Info is found by matching the header of a world file as
+// it is closed after loading, as the engine keeps an exact copy of it.
+// Board is found by its tile array: a 62x27 grid, column-major, with
+// board edges all along the first and last column.
+
+#define ZZT_OBSERVE_CACHE_SIZE 4
+
+#define ZZT_BOARD_TILES_OFFSET 51
+#define ZZT_BOARD_TILES_WIDTH 62
+#define ZZT_BOARD_TILES_HEIGHT 27
+#define ZZT_BOARD_STAT_COUNT_OFFSET (ZZT_BOARD_TILES_OFFSET + ZZT_BOARD_TILES_WIDTH * ZZT_BOARD_TILES_HEIGHT * 2)
+#define ZZT_BOARD_STATS_OFFSET (ZZT_BOARD_STAT_COUNT_OFFSET + 2)
+#define ZZT_BOARD_MAX_STAT 150
+#define ZZT_ELEMENT_BOARD_EDGE 1
+
+typedef struct {
+	u64 engine_hash;
+	u32 world_addr, board_addr; // 0 if not found yet
+} zzt_observe_entry;
+
+static zzt_observe_entry zzt_observe_cache[ZZT_OBSERVE_CACHE_SIZE];
+static int zzt_observe_world_handle = -1;
+// the buffer the world header was read into, which is not World.Info
+static u32 zzt_observe_read_addr, zzt_observe_read_len;
+static double zzt_observe_board_scan_time = -1;
+static int zzt_observe_start_board = -1;
+
+static void zzt_observe_reset(void) {
+	zzt_observe_world_handle = -1;
+	zzt_observe_read_len = 0;
+	zzt_observe_board_scan_time = -1;
+}
+
+static zzt_observe_entry *zzt_observe_get_entry(void) {
+	u64 hash = zzt_get_engine_hash();
+	int i;
+
+	for (i = 0; i < ZZT_OBSERVE_CACHE_SIZE; i++) {
+		if (zzt_observe_cache[i].engine_hash == hash) return &zzt_observe_cache[i];
+	}
+	// evict the oldest
+	memmove(zzt_observe_cache + 1, zzt_observe_cache, sizeof(zzt_observe_entry) * (ZZT_OBSERVE_CACHE_SIZE - 1));
+	memset(zzt_observe_cache, 0, sizeof(zzt_observe_entry));
+	zzt_observe_cache[0].engine_hash = hash;
+	return &zzt_observe_cache[0];
+}
+
+static void zzt_observe_file_opened(int handle, const char *filename) {
+	int len = strlen(filename);
+	const char *ext = filename + len - 4;
+
+	if (len >= 4 && ext[0] == '.' && (ext[1] & 0xDF) == 'Z' && (ext[2] & 0xDF) == 'Z' && (ext[3] & 0xDF) == 'T') {
+		zzt_observe_world_handle = handle;
+		zzt_observe_read_len = 0;
+	}
+}
+
+// the header of new-format worlds starts with a version marker of -1
+static void zzt_observe_patch_header(u8 *header, int len) {
+	if (zzt_observe_start_board >= 0 && len >= 4 + ZZT_WORLD_INFO_BOARD + 2
+		&& header[0] == 0xFF && header[1] == 0xFF)
+	{
+		header[4 + ZZT_WORLD_INFO_BOARD] = zzt_observe_start_board & 0xFF;
+		header[4 + ZZT_WORLD_INFO_BOARD + 1] = zzt_observe_start_board >> 8;
+	}
+}
+
+static void zzt_observe_file_read(int handle, u32 addr, int len) {
+	if (handle == zzt_observe_world_handle && zzt_observe_read_len == 0 && len > 0) {
+		zzt_observe_read_addr = addr;
+		zzt_observe_read_len = len;
+		zzt_observe_patch_header(zzt.cpu.ram + addr, len);
+	}
+}
+
+static void zzt_observe_file_closing(int handle) {
+	u8 header[ZZT_OBSERVE_WORLD_HEADER_SIZE];
+
+	if (handle != zzt_observe_world_handle) return;
+	zzt_observe_world_handle = -1;
+	if (zzt_observe_get_entry()->world_addr != 0) return;
+
+	vfs_seek(handle, 0, VFS_SEEK_SET);
+	if (vfs_read(handle, header, sizeof(header)) == sizeof(header)) {
+		zzt_observe_patch_header(header, sizeof(header));
+		zzt_observe_locate_world(header, sizeof(header));
+	}
+}
+
+void zzt_set_start_board(int board) {
+	zzt_observe_start_board = board;
+}
+
+int zzt_observe_locate_world(const u8 *header, int len) {
+	const u8 *info = header + 4;
+	u8 *ram = zzt.cpu.ram;
+	zzt_observe_entry *entry = zzt_observe_get_entry();
+
+	if (len < ZZT_OBSERVE_WORLD_HEADER_SIZE || info[ZZT_WORLD_INFO_NAME] > 20) return -1;
+	// only the used part of the name is meaningful
+	int match_len = ZZT_WORLD_INFO_NAME + 1 + info[ZZT_WORLD_INFO_NAME];
+
+	for (u32 addr = 0x1000; addr < 0xA0000 - match_len; addr++) {
+		if (addr >= zzt_observe_read_addr && addr < zzt_observe_read_addr + zzt_observe_read_len) continue;
+		if (ram[addr] == info[0] && memcmp(ram + addr, info, match_len) == 0) {
+			entry->world_addr = addr;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int zzt_observe_board_valid(u32 addr) {
+	u8 *tiles = zzt.cpu.ram + addr + ZZT_BOARD_TILES_OFFSET;
+	int last_column = (ZZT_BOARD_TILES_WIDTH - 1) * ZZT_BOARD_TILES_HEIGHT * 2;
+
+	for (int y = 0; y < ZZT_BOARD_TILES_HEIGHT; y++) {
+		if (tiles[y * 2] != ZZT_ELEMENT_BOARD_EDGE || tiles[last_column + y * 2] != ZZT_ELEMENT_BOARD_EDGE) {
+			return 0;
+		}
+	}
+	int stat_count = (s16) (tiles[ZZT_BOARD_STAT_COUNT_OFFSET - ZZT_BOARD_TILES_OFFSET]
+		| (tiles[ZZT_BOARD_STAT_COUNT_OFFSET - ZZT_BOARD_TILES_OFFSET + 1] << 8));
+	return stat_count >= 0 && stat_count <= ZZT_BOARD_MAX_STAT;
+}
+
+static void zzt_observe_locate_board(zzt_observe_entry *entry) {
+	u32 start = 0x1000;
+	u32 end = 0xA0000 - (ZZT_BOARD_STATS_OFFSET + 2);
+
+	// Board and World share the data segment
+	if (entry->world_addr != 0) {
+		if (entry->world_addr > start + 0x10000) start = entry->world_addr - 0x10000;
+		if (entry->world_addr + 0x10000 < end) end = entry->world_addr + 0x10000;
+	}
+
+	for (u32 addr = start; addr < end; addr++) {
+		if (zzt.cpu.ram[addr + ZZT_BOARD_TILES_OFFSET] == ZZT_ELEMENT_BOARD_EDGE && zzt_observe_board_valid(addr)) {
+			entry->board_addr = addr;
+			return;
+		}
+	}
+}
+
+const u8 *zzt_observe_world_info(void) {
+	zzt_observe_entry *entry = zzt_observe_get_entry();
+
+	if (entry->world_addr == 0) return NULL;
+	return zzt.cpu.ram + entry->world_addr;
+}
+
+const u8 *zzt_observe_board(void) {
+	zzt_observe_entry *entry = zzt_observe_get_entry();
+
+	if (entry->board_addr != 0 && !zzt_observe_board_valid(entry->board_addr)) {
+		// not a board anymore; the board is not loaded yet if nothing else is found
+		entry->board_addr = 0;
+	}
+	if (entry->board_addr == 0) {
+		// at most one scan per second of emulated time
+		if (zzt_observe_board_scan_time >= 0 && (zzt.timer_time - zzt_observe_board_scan_time) < 1000) return NULL;
+		zzt_observe_board_scan_time = zzt.timer_time;
+		zzt_observe_locate_board(entry);
+		if (entry->board_addr == 0) return NULL;
+	}
+	return zzt.cpu.ram + entry->board_addr;
+}
+
+#define OBS_R16(p, pos) ((s16) ((p)[pos] | ((p)[(pos) + 1] << 8)))
+
+int zzt_observe(zzt_game_state *state) {
+	const u8 *world = zzt_observe_world_info();
+	const u8 *board = zzt_observe_board();
+	int result = 0;
+
+	memset(state, 0, sizeof(zzt_game_state));
+	if (world != NULL) {
+		state->ammo = OBS_R16(world, ZZT_WORLD_INFO_AMMO);
+		state->gems = OBS_R16(world, ZZT_WORLD_INFO_GEMS);
+		memcpy(state->keys, world + ZZT_WORLD_INFO_KEYS, 7);
+		state->health = OBS_R16(world, ZZT_WORLD_INFO_HEALTH);
+		state->board_id = OBS_R16(world, ZZT_WORLD_INFO_BOARD);
+		state->torches = OBS_R16(world, ZZT_WORLD_INFO_TORCHES);
+		state->torch_ticks = OBS_R16(world, ZZT_WORLD_INFO_TORCH_TICKS);
+		state->energizer_ticks = OBS_R16(world, ZZT_WORLD_INFO_ENERGIZER_TICKS);
+		state->score = OBS_R16(world, ZZT_WORLD_INFO_SCORE);
+		int name_len = world[ZZT_WORLD_INFO_NAME];
+		if (name_len > 20) name_len = 20;
+		memcpy(state->world_name, world + ZZT_WORLD_INFO_NAME + 1, name_len);
+		result |= ZZT_OBSERVE_WORLD;
+	}
+	if (board != NULL) {
+		state->stat_count = OBS_R16(board, ZZT_BOARD_STAT_COUNT_OFFSET);
+		state->player_x = board[ZZT_BOARD_STATS_OFFSET];
+		state->player_y = board[ZZT_BOARD_STATS_OFFSET + 1];
+		result |= ZZT_OBSERVE_BOARD;
+	}
+	return result;
+}
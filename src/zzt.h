@@ -62,11 +62,17 @@ void zzt_mouse_clear(int button);
 USER_FUNCTION
 void zzt_init(int memory_kbs);
 USER_FUNCTION
-void zzt_load_binary(int handle, const char *arg);
+int zzt_load_binary(int handle, const char *arg);
 USER_FUNCTION
 int zzt_execute(int opcodes);
 USER_FUNCTION
 u8* zzt_get_ram(void);
+
+// one bit per text cell (offset / 2), set if changed since the last call;
+// returns the number of changed cells
+#define ZZT_VRAM_DIRTY_SIZE ((80*25 + 7) / 8)
+USER_FUNCTION
+int zzt_vram_get_dirty(u8* bitmap);
 USER_FUNCTION
 void zzt_mark_frame(void);
 USER_FUNCTION
@@ -79,11 +85,174 @@ USER_FUNCTION
 int zzt_key_get_repeat_delay(void);
 USER_FUNCTION
 void zzt_key_set_delay(int ms, int repeat_ms);
+
+// keystrokes waiting for the engine; pending keystrokes are kept when
+// the buffer is resized, as long as they fit
+#define ZZT_KEYBUF_MAX_SIZE 2048
+
+typedef struct {
+	u32 appended, read;
+	u32 dropped; // buffer full
+	u32 culled; // repeats removed on key release
+} zzt_keybuf_stats;
+
+USER_FUNCTION
+int zzt_key_set_buffer_size(int size);
+USER_FUNCTION
+int zzt_key_get_buffer_size(void);
+USER_FUNCTION
+void zzt_key_get_stats(zzt_keybuf_stats *stats);
 USER_FUNCTION
 void zzt_set_timer_offset(long ms);
+// number of times the guest yielded while polling an empty keyboard buffer
+USER_FUNCTION
+int zzt_kbd_idle_count(void);
+
+#define ZZT_SNAPSHOT_VERSION 2
+// upper bound for the size of a snapshot
+#define ZZT_SNAPSHOT_MAX_SIZE (16384 + CPU_PAGE_COUNT * (CPU_PAGE_SIZE + (CPU_PAGE_SIZE / 128) + 4))
+
+USER_FUNCTION
+int zzt_snapshot_save(u8* data, int len);
+USER_FUNCTION
+int zzt_snapshot_load(const u8* data, int len);
+
+// forks - cheap in-process copies of the machine state, sharing
+// unmodified RAM pages; returns a fork ID, or a negative value on error.
+// Open and written files are forked along with the machine where the
+// VFS supports it (vfs_fork_*), and shared between forks otherwise
+USER_FUNCTION
+int zzt_fork_create(void);
+USER_FUNCTION
+int zzt_fork_switch(int id);
+USER_FUNCTION
+void zzt_fork_free(int id);
+
+// diagnostics for unhandled ports and interrupts; the emulator counts
+// them per key and queues rate-limited messages for the frontend to drain
+#define ZZT_LOG_PORT_IN 0
+#define ZZT_LOG_PORT_OUT 1
+#define ZZT_LOG_CRT_IN 2
+#define ZZT_LOG_CRT_OUT 3
+#define ZZT_LOG_INTERRUPT 4 /* id = (interrupt << 8) | function */
+#define ZZT_LOG_NATIVE 5 /* id = low word of the routine's address, or 0 */
+
+typedef struct {
+	u16 type;
+	u16 id;
+	u32 count;
+} zzt_log_counter;
+
+USER_FUNCTION
+void zzt_log(int type, int id, const char *fmt, ...);
+// copies the oldest queued message to buf; returns 0 if there is none
+USER_FUNCTION
+int zzt_log_drain(char *buf, int len);
+USER_FUNCTION
+int zzt_log_get_counters(zzt_log_counter *counters, int max);
+USER_FUNCTION
+u32 zzt_log_dropped_count(void);
+
+// emulation speed, as a multiple of the original: 1, 2, 4 or 8. Frontends
+// divide their timer tick interval by it, or with ZZT_SPEED_UNLIMITED tick
+// every time the engine waits. At higher speeds, sound plays at the
+// original pitch, with notes shortened (KEEP) or not at all (MUTE, always
+// when unlimited)
+#define ZZT_SPEED_UNLIMITED 0
+#define ZZT_SPEED_MAX 8
+#define ZZT_SPEED_AUDIO_KEEP 0
+#define ZZT_SPEED_AUDIO_MUTE 1
+USER_FUNCTION
+int zzt_set_speed(int speed, int audio_mode);
+USER_FUNCTION
+int zzt_get_speed(void);
+
+// game state, read from the engine's memory (ZZT 3.2 layout); the
+// engine's structures are located once and then read in place
+#define ZZT_OBSERVE_WORLD 1
+#define ZZT_OBSERVE_BOARD 2
+
+// World.Info field offsets
+#define ZZT_WORLD_INFO_AMMO 0
+#define ZZT_WORLD_INFO_GEMS 2
+#define ZZT_WORLD_INFO_KEYS 4
+#define ZZT_WORLD_INFO_HEALTH 11
+#define ZZT_WORLD_INFO_BOARD 13
+#define ZZT_WORLD_INFO_TORCHES 15
+#define ZZT_WORLD_INFO_TORCH_TICKS 17
+#define ZZT_WORLD_INFO_ENERGIZER_TICKS 19
+#define ZZT_WORLD_INFO_SCORE 23
+#define ZZT_WORLD_INFO_NAME 25 /* Pascal string, up to 20 characters */
+
+typedef struct {
+	s16 ammo, gems, health, torches, score;
+	s16 torch_ticks, energizer_ticks;
+	u8 keys[7];
+	s16 board_id;
+	char world_name[21];
+	s16 stat_count;
+	u8 player_x, player_y;
+} zzt_game_state;
+
+// returns a mask of ZZT_OBSERVE_* for the parts of state filled in
+USER_FUNCTION
+int zzt_observe(zzt_game_state *state);
+// pointers into emulated memory, or NULL if not located
+USER_FUNCTION
+const u8 *zzt_observe_world_info(void);
+USER_FUNCTION
+const u8 *zzt_observe_board(void);
+// world file bytes needed to locate World.Info: up to and including the name
+#define ZZT_OBSERVE_WORLD_HEADER_SIZE 50
+// locate World.Info from the first ZZT_OBSERVE_WORLD_HEADER_SIZE bytes of
+// the world file; done automatically when the engine loads a .ZZT file
+USER_FUNCTION
+int zzt_observe_locate_world(const u8 *header, int len);
+// make worlds loaded from now on start on the given board, by patching
+// the header as the engine reads it; -1 to load worlds unchanged
+USER_FUNCTION
+void zzt_set_start_board(int board);
+
+// native replacements for hot engine routines, located by signature
+#define ZZT_HLE_OFF 0
+#define ZZT_HLE_ON 1
+#define ZZT_HLE_VERIFY 2 /* compare against the interpreted code */
+USER_FUNCTION
+void zzt_hle_set_mode(int mode);
+// hash of the last loaded binary's image
+USER_FUNCTION
+u64 zzt_get_engine_hash(void);
 
+// run-ahead - emulate the given number of timer ticks with the current
+// input, copy the resulting text memory (80*25*2 bytes) to vram, then
+// return to the present; stops early once the engine accesses files
 USER_FUNCTION
-int zzt_load_charset(int width, int height, u8* data);
+int zzt_run_ahead(int ticks, u8* vram);
+
+// rewind - periodic delta-compressed captures of the machine state,
+// taken every interval_ticks timer ticks and kept within max_bytes
+typedef struct {
+	int entries; // capture points available
+	int bytes; // memory in use, including fixed buffers
+	u32 captures;
+	u32 pages_captured;
+	u64 capture_us; // total time spent capturing
+} zzt_rewind_stats;
+
+#define ZZT_REWIND_DEFAULT_MAX_BYTES (32 * 1024 * 1024)
+
+USER_FUNCTION
+int zzt_rewind_configure(int interval_ticks, int max_bytes);
+USER_FUNCTION
+int zzt_rewind_count(void);
+// go back to the steps-th most recent capture point, discarding newer ones
+USER_FUNCTION
+int zzt_rewind(int steps);
+USER_FUNCTION
+void zzt_rewind_get_stats(zzt_rewind_stats* stats);
+
+USER_FUNCTION
+int zzt_load_charset(int width, int height, const u8* data);
 USER_FUNCTION
 int zzt_load_palette(u32* colors);
 
@@ -104,6 +273,10 @@ IMPLEMENT_FUNCTION
 int vfs_seek(int handle, int pos, int type);
 IMPLEMENT_FUNCTION
 int vfs_read(int handle, u8* ptr, int amount);
+// the whole contents of an open file, valid until it is closed, or NULL
+// if they are not available without copying - then use vfs_read
+IMPLEMENT_FUNCTION
+const u8* vfs_get_data(int handle, int* len);
 IMPLEMENT_FUNCTION
 int vfs_write(int handle, u8* ptr, int amount);
 IMPLEMENT_FUNCTION
@@ -112,6 +285,15 @@ IMPLEMENT_FUNCTION
 int vfs_findfirst(u8* ptr, u16 mask, char* spec);
 IMPLEMENT_FUNCTION
 int vfs_findnext(u8* ptr);
+// the files of a fork: keeps the open files, their positions and the
+// files written so far under a fork ID, switches back to them, or drops
+// them. Optional - return a negative value where files are not forked
+IMPLEMENT_FUNCTION
+int vfs_fork_create(int id);
+IMPLEMENT_FUNCTION
+int vfs_fork_switch(int id);
+IMPLEMENT_FUNCTION
+void vfs_fork_free(int id);
 
 #define FEATURE_JOY_CONNECTED 1
 #define FEATURE_MOUSE_CONNECTED 2